@@ -3,8 +3,13 @@
 // https://invisible-island.net/xterm/ctlseqs/ctlseqs.html
 // https://man.freebsd.org/cgi/man.cgi?query=screen&apropos=0&sektion=4&manpath=FreeBSD+5.4-RELEASE&format=html
 #pragma once
+#include <algorithm>
+#include <array>
 #include <charconv>
-#include <string>
+#include <cstdint>
+#include <ostream>
+#include <string_view>
+#include <utility>
 
 // The escape character, '\033', followed by
 // the control sequence introducer (CSI), '[', followed by
@@ -12,29 +17,43 @@
 // a command character.
 namespace ansi {
 
+/**
+ * An escape sequence of at most `capacity` characters, held in place: building one allocates
+ * nothing, and one built from constants is itself a constant.
+ */
+template <size_t capacity> class sequence {
+  std::array<char, capacity> chars{};
+  size_t length = 0;
+
+public:
+  constexpr sequence() noexcept = default;
+
+  constexpr sequence &append(const std::string_view s) noexcept {
+    length = std::ranges::copy(s.substr(0, capacity - length), chars.begin() + length).out -
+             chars.begin();
+    return *this;
+  }
+  constexpr sequence &append(const char c) noexcept { return append(std::string_view(&c, 1)); }
+  constexpr sequence &append(const uint8_t n) noexcept {
+    length = std::to_chars(chars.data() + length, chars.data() + capacity, n).ptr - chars.data();
+    return *this;
+  }
+
+  [[nodiscard]] constexpr std::string_view view() const noexcept { return {chars.data(), length}; }
+  constexpr operator std::string_view() const noexcept { return view(); }
+
+  friend std::ostream &operator<<(std::ostream &os, const sequence &s) { return os << s.view(); }
+};
+
 // Rows and columns are 1-based.
-constexpr std::string cursor_position(const uint8_t row, const uint8_t col) {
-  char array[] = "\033[row;colH";
-  auto first = std::begin(array) + 2;
-  const auto last = std::end(array);
-  first = std::to_chars(first, last, row).ptr;
-  *first++ = ';';
-  first = std::to_chars(first, last, col).ptr;
-  *first++ = 'H';
-  *first = '\0';
-  return array;
+constexpr auto cursor_position(const uint8_t row, const uint8_t col) noexcept {
+  return sequence<10>().append("\033[").append(row).append(";").append(col).append("H");
 }
 
 namespace impl {
 
-template <char command> constexpr std::string move_cursor(const uint8_t offset) {
-  char array[] = "\033[nnnX";
-  auto first = std::begin(array) + 2;
-  const auto last = std::end(array);
-  first = std::to_chars(first, last, offset).ptr;
-  *first++ = command;
-  *first = '\0';
-  return array;
+template <char command> constexpr auto move_cursor(const uint8_t offset) noexcept {
+  return sequence<7>().append("\033[").append(offset).append(command);
 }
 
 } // namespace impl
@@ -49,6 +68,8 @@ constexpr auto cursor_show{"\033[?25h"};
 constexpr auto cursor_steady_block{"\033[0 q"};
 constexpr auto cursor_blinking_block{"\033[1 q"};
 constexpr auto cursor_reset{"\033[H"};
+constexpr auto cursor_save{"\0337"};
+constexpr auto cursor_restore{"\0338"};
 
 constexpr auto clear_screen{"\033[2J"};
 constexpr auto hard_clear_screen{"\033[3J\033c"};
@@ -106,14 +127,8 @@ namespace impl {
 // 95  105  Bright Magenta rgb(255, 85, 255)
 // 96  106  Bright Cyan    rgb(85, 255, 255)
 // 97  107  Bright White  rgb(255, 255, 255)
-constexpr std::string color(const uint8_t c) {
-  char array[] = "\033[NNNm";
-  auto first = std::begin(array) + 2;
-  const auto last = std::end(array);
-  first = std::to_chars(first, last, c).ptr;
-  *first++ = 'm';
-  *first = '\0';
-  return array;
+constexpr auto color(const uint8_t c) noexcept {
+  return sequence<6>().append("\033[").append(c).append("m");
 }
 
 } // namespace impl
@@ -132,4 +147,8 @@ constexpr auto background(const color c, const bool bright) {
 constexpr auto background_dark(const color c) { return background(c, false); }
 constexpr auto background_bright(const color c) { return background(c, true); }
 
+static_assert(cursor_position(10, 17).view() == "\033[10;17H");
+static_assert(cursor_up(3).view() == "\033[3A");
+static_assert(foreground_bright(color::green).view() == "\033[92m");
+
 } // namespace ansi
@@ -0,0 +1,12 @@
+// The operands of the command-line tools, which take their options through getopt.
+#pragma once
+#include <charconv>
+#include <cstring>
+#include <system_error>
+
+/** Parses all of `arg` as a number into `value`; whether it is one, with nothing after it. */
+bool parse(const char *const arg, auto &value) {
+  const auto last = arg + std::strlen(arg);
+  const auto [ptr, ec] = std::from_chars(arg, last, value);
+  return ec == std::errc{} && ptr == last;
+}
@@ -0,0 +1,342 @@
+// https://www.chessprogramming.org/Kogge-Stone_Algorithm
+#pragma once
+#include "chess.hpp"
+#include "isa.hpp"
+#include <array>
+#include <cstring>
+#include <span>
+#include <type_traits>
+#include <vector>
+
+/**
+ * Whether squares are attacked, for many independent positions at once: one question per
+ * position, such as whether the side to move is in check. Positions are laid out field by field,
+ * a 64-bit word each, so that a vector register holds the same field of 4 or 8 of them, and every
+ * attack is computed by shifts and masks that all lanes run in step. Sliders are found by
+ * Kogge-Stone fills rather than table lookups, which do not vectorize.
+ *
+ * The kernels are one template, compiled for each instruction set; the scalar one is the
+ * reference, and `bench` checks the others and `configuration::in_check` against it.
+ */
+namespace attack_batch {
+
+/** The fields of a position, each one word: the square in question and the attacking side. */
+enum field : uint8_t {
+  target,     // The square, as a bitboard of one bit.
+  occupied,   // Both sides.
+  pawns,      // The attacker's, as are all the pieces below.
+  knights,    //
+  kings,      //
+  diagonal,   // Bishops and queens.
+  orthogonal, // Rooks and queens.
+  downward,   // All ones if the attacker is black, whose pawns capture toward rank 1.
+  fields,
+};
+
+using columns = std::array<const uint64_t *, fields>;
+
+namespace impl {
+
+constexpr uint64_t all = ~uint64_t{0};
+constexpr uint64_t not_h = 0xFEFE'FEFE'FEFE'FEFE, not_a = 0x7F7F'7F7F'7F7F'7F7F;
+constexpr uint64_t not_gh = 0xFCFC'FCFC'FCFC'FCFC, not_ab = 0x3F3F'3F3F'3F3F'3F3F;
+
+/** A step on the board: `by` squares up the numbering, `wrap` the squares it cannot land on. */
+struct direction {
+  int by;
+  uint64_t wrap;
+};
+// West is toward the a file, up the numbering within a rank.
+constexpr direction north{8, all}, south{-8, all}, west{1, not_h}, east{-1, not_a},
+    north_west{9, not_h}, north_east{7, not_a}, south_west{-7, not_h}, south_east{-9, not_a};
+
+// Vectors are only passed by reference: by value, their ABI would depend on the instruction set.
+template <int by, class W> [[gnu::always_inline]] constexpr void shift(W &x) noexcept {
+  if constexpr (by > 0) {
+    x <<= by;
+  } else {
+    x >>= -by;
+  }
+}
+
+// Adds to `into` the squares one step from `from` toward `d`.
+template <direction d, class W>
+[[gnu::always_inline]] constexpr void step(W &into, const W &from) noexcept {
+  W x = from;
+  shift<d.by>(x);
+  into |= x & d.wrap;
+}
+
+// Adds to `into` the squares a slider on `from` attacks toward `d`, the first occupied one
+// included: an occluded fill over the empty squares in 3 doublings, then one more step.
+template <direction d, class W>
+[[gnu::always_inline]] constexpr void ray(W &into, const W &from, const W &empty) noexcept {
+  W generate = from, propagate = empty & d.wrap, x = generate;
+  shift<d.by>(x);
+  generate |= propagate & x;
+  x = propagate;
+  shift<d.by>(x);
+  propagate &= x;
+  x = generate;
+  shift<2 * d.by>(x);
+  generate |= propagate & x;
+  x = propagate;
+  shift<2 * d.by>(x);
+  propagate &= x;
+  x = generate;
+  shift<4 * d.by>(x);
+  generate |= propagate & x;
+  step<d>(into, generate);
+}
+
+template <direction... d, class W>
+[[gnu::always_inline]] constexpr void steps(W &into, const W &from) noexcept {
+  (step<d>(into, from), ...);
+}
+
+template <direction... d, class W>
+[[gnu::always_inline]] constexpr void rays(W &into, const W &from, const W &empty) noexcept {
+  (ray<d>(into, from, empty), ...);
+}
+
+template <class W> [[gnu::always_inline]] constexpr void load(W &x, const uint64_t *const p) {
+  if constexpr (std::is_same_v<W, uint64_t>) {
+    x = *p;
+  } else {
+    std::memcpy(&x, p, sizeof(x));
+  }
+}
+
+template <class W> [[gnu::always_inline]] constexpr void store(uint64_t *const p, const W &x) {
+  if constexpr (std::is_same_v<W, uint64_t>) {
+    *p = x;
+  } else {
+    std::memcpy(p, &x, sizeof(x));
+  }
+}
+
+// out[i] = the pieces attacking the target of position i, for `count` positions, a multiple of
+// the lanes of `W`: a word, or a vector of them.
+template <class W>
+[[gnu::always_inline]] constexpr void attackers(const columns &in, uint64_t *const out,
+                                                const size_t count) noexcept {
+  constexpr size_t lanes = sizeof(W) / sizeof(uint64_t);
+  for (size_t i = 0; i < count; i += lanes) {
+    std::array<W, fields> f;
+    for (size_t k = 0; k < fields; ++k) {
+      load(f[k], in[k] + i);
+    }
+    const W &t = f[target];
+    const W empty = ~f[occupied];
+    W found{};
+    W jumps{};
+    steps<direction{17, not_h}, direction{15, not_a}, direction{10, not_gh}, direction{6, not_ab},
+          direction{-6, not_gh}, direction{-10, not_ab}, direction{-15, not_h},
+          direction{-17, not_a}>(jumps, t);
+    found |= jumps & f[knights];
+    W around{};
+    steps<north, south, west, east, north_west, north_east, south_west, south_east>(around, t);
+    found |= around & f[kings];
+    // A pawn attacks the target from where a pawn of the other color on the target would capture.
+    W above{}, below{};
+    steps<north_west, north_east>(above, t);
+    steps<south_west, south_east>(below, t);
+    found |= ((above & f[downward]) | (below & ~f[downward])) & f[pawns];
+    W lines{};
+    rays<north, south, west, east>(lines, t, empty);
+    found |= lines & f[orthogonal];
+    W diagonals{};
+    rays<north_west, north_east, south_west, south_east>(diagonals, t, empty);
+    found |= diagonals & f[diagonal];
+    store(out + i, found);
+  }
+}
+
+template <size_t lanes> using vector = uint64_t __attribute__((vector_size(8 * lanes)));
+
+inline void attackers_scalar(const columns &in, uint64_t *const out, const size_t count) noexcept {
+  attackers<uint64_t>(in, out, count);
+}
+
+#if defined(__x86_64__) || defined(__i386__)
+
+__attribute__((target("avx2"))) inline void
+attackers_avx2(const columns &in, uint64_t *const out, const size_t count) noexcept {
+  attackers<vector<4>>(in, out, count);
+}
+
+__attribute__((target("avx512f"))) inline void
+attackers_avx512(const columns &in, uint64_t *const out, const size_t count) noexcept {
+  attackers<vector<8>>(in, out, count);
+}
+
+constexpr std::array by_isa{attackers_scalar, attackers_avx2, attackers_avx512};
+#else
+constexpr std::array by_isa{attackers_scalar, attackers_scalar, attackers_scalar};
+#endif
+
+/** The fields of `config` for whether `s` is attacked by the given color. */
+template <class Side>
+constexpr std::array<uint64_t, fields> columns_of(const basic_configuration<Side> &config,
+                                                  const square s, const bool by_white) noexcept {
+  const auto &them = by_white ? config.get_white() : config.get_black();
+  const auto queens = them.get_bitboard(piece::queen);
+  std::array<uint64_t, fields> f;
+  f[target] = uint64_t{1} << s;
+  f[occupied] = config.get_white().get_occupancy() | config.get_black().get_occupancy();
+  f[pawns] = them.get_bitboard(piece::pawn);
+  f[knights] = them.get_bitboard(piece::knight);
+  f[kings] = them.get_bitboard(piece::king);
+  f[diagonal] = them.get_bitboard(piece::bishop) | queens;
+  f[orthogonal] = them.get_bitboard(piece::rook) | queens;
+  f[downward] = by_white ? 0 : all;
+  return f;
+}
+
+// The scalar kernel on one position, for the checks below.
+[[nodiscard]] constexpr bool in_check(const configuration &config) noexcept {
+  const auto &us = config.is_white_turn() ? config.get_white() : config.get_black();
+  const auto f = columns_of(config, us.get_king_square(), !config.is_white_turn());
+  columns in;
+  for (size_t k = 0; k < fields; ++k) {
+    in[k] = &f[k];
+  }
+  uint64_t found = 0;
+  attackers<uint64_t>(in, &found, 1);
+  return found;
+}
+
+struct placed {
+  bool is_white;
+  piece p;
+  int s;
+};
+
+// Positions where each kind of piece gives check, or is kept from giving it.
+constexpr configuration position(const bool white_turn, const auto... pieces) {
+  auto white = side::empty(), black = side::empty();
+  for (const placed x : {pieces...}) {
+    (x.is_white ? white : black).insert(x.p, x.s);
+  }
+  return configuration(white, black, white_turn, 0);
+}
+// Kings on e1 (3) and e8 (59) unless said otherwise.
+constexpr placed white_king{true, piece::king, 3}, black_king{false, piece::king, 59};
+static_assert(!in_check(configuration()));
+static_assert(in_check(position(true, white_king, black_king, placed{false, piece::rook, 35})));
+static_assert(!in_check(position(true, white_king, black_king, placed{false, piece::rook, 35},
+                                 placed{true, piece::pawn, 11})));
+static_assert(in_check(position(true, white_king, black_king, placed{false, piece::bishop, 30})));
+static_assert(in_check(position(true, white_king, black_king, placed{false, piece::knight, 18})));
+static_assert(in_check(position(true, white_king, black_king, placed{false, piece::pawn, 12})));
+static_assert(!in_check(position(true, white_king, black_king, placed{false, piece::pawn, 11})));
+static_assert(in_check(position(false, white_king, black_king, placed{true, piece::pawn, 50})));
+static_assert(!in_check(position(false, white_king, black_king, placed{true, piece::pawn, 51})));
+// A queen on h3 does not reach a2 by wrapping around the edge of the board.
+static_assert(!in_check(
+    position(true, placed{true, piece::king, 15}, black_king, placed{false, piece::queen, 16})));
+
+} // namespace impl
+
+/** Whether the machine runs the kernels of `set`, which need no more than AVX-512F. */
+[[nodiscard]] inline bool supported(const isa set) noexcept { return runs_isa(set, false); }
+
+/** The widest instruction set the machine runs the kernels of. */
+[[nodiscard]] inline isa best_isa() noexcept { return widest_isa(false); }
+
+/**
+ * A batch of questions, each whether a square of a position is attacked by a color; the fields
+ * of every position are taken from the occupancy and the pieces of its sides. Storage grows 8
+ * positions at a time, the padding asking about no square at all, so that kernels need no tail.
+ */
+class positions {
+  static constexpr size_t block = 8;
+
+  std::array<std::vector<uint64_t>, fields> data;
+  size_t count = 0;
+
+public:
+  [[nodiscard]] size_t size() const noexcept { return count; }
+  /** The size rounded up to a whole number of blocks, as the kernels see it. */
+  [[nodiscard]] size_t padded_size() const noexcept { return data[0].size(); }
+
+  void clear() noexcept {
+    for (auto &column : data) {
+      column.clear();
+    }
+    count = 0;
+  }
+
+  void reserve(const size_t n) {
+    for (auto &column : data) {
+      column.reserve((n + block - 1) / block * block);
+    }
+  }
+
+  /** Asks whether `s` is attacked by the given color in `config`. */
+  template <class Side>
+  void push_back(const basic_configuration<Side> &config, const square s, const bool by_white) {
+    if (count % block == 0) {
+      for (auto &column : data) {
+        column.resize(column.size() + block);
+      }
+    }
+    const auto f = impl::columns_of(config, s, by_white);
+    for (size_t k = 0; k < fields; ++k) {
+      data[k][count] = f[k];
+    }
+    ++count;
+  }
+
+  /** Asks whether the side to move is in check in `config`. */
+  template <class Side> void push_back(const basic_configuration<Side> &config) {
+    const auto &us = config.is_white_turn() ? config.get_white() : config.get_black();
+    push_back(config, us.get_king_square(), !config.is_white_turn());
+  }
+
+  [[nodiscard]] columns get_columns() const noexcept {
+    columns in;
+    for (size_t k = 0; k < fields; ++k) {
+      in[k] = data[k].data();
+    }
+    return in;
+  }
+};
+
+/**
+ * The pieces attacking the square of each position, none if it is not attacked; `out` holds at
+ * least `batch.padded_size()` words.
+ */
+inline void attackers(const positions &batch, const std::span<uint64_t> out,
+                      const isa set = best_isa()) noexcept {
+  assert(out.size() >= batch.padded_size() && supported(set));
+  impl::by_isa[std::to_underlying(set)](batch.get_columns(), out.data(), batch.padded_size());
+}
+
+/**
+ * Whether the square of each position is attacked, one bit per position, the first in the lowest
+ * bit of `out[0]`; `out` holds at least `(batch.size() + 63) / 64` words.
+ */
+inline void attacked(const positions &batch, const std::span<uint64_t> out,
+                     const isa set = best_isa()) noexcept {
+  assert(out.size() * 64 >= batch.size() && supported(set));
+  const auto kernel = impl::by_isa[std::to_underlying(set)];
+  auto in = batch.get_columns();
+  std::array<uint64_t, 64> found;
+  for (size_t i = 0; i < batch.padded_size(); i += found.size()) {
+    const auto n = std::min(found.size(), batch.padded_size() - i);
+    kernel(in, found.data(), n);
+    uint64_t bits = 0;
+    for (size_t k = 0; k < n; ++k) {
+      bits |= static_cast<uint64_t>(found[k] != 0) << k;
+    }
+    if (i / 64 < out.size()) {
+      out[i / 64] = bits;
+    }
+    for (auto &column : in) {
+      column += n;
+    }
+  }
+}
+
+} // namespace attack_batch
@@ -0,0 +1,475 @@
+// Microbenchmarks of the primitives of chess.hpp over a fixed corpus of positions, with hardware
+// counters where the kernel lets us read them, written to a file that a later run compares with.
+#include "arguments.hpp"
+#include "attack_batch.hpp"
+#include "chess.hpp"
+#include "fen.hpp"
+#include "hot_path.hpp"
+#include "perft.hpp"
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <span>
+#include <sstream>
+#include <string>
+#include <unistd.h>
+#include <vector>
+#ifdef __linux__
+#include <linux/perf_event.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#endif
+
+/**
+ * Cycles, instructions, branch misses and cache misses of the calling thread in user space, read
+ * as one group through perf_event_open(2). Unavailable off Linux, where the hardware or a virtual
+ * machine lacks one of them, or where perf_event_paranoid forbids it.
+ */
+class hardware_counters {
+public:
+  static constexpr std::array<std::string_view, 4> names{"cycles", "instructions",
+                                                          "branch_misses", "cache_misses"};
+  using values = std::array<uint64_t, names.size()>;
+
+private:
+  std::array<int, names.size()> fds;
+
+public:
+  hardware_counters() noexcept {
+    fds.fill(-1);
+#ifdef __linux__
+    constexpr std::array configs{PERF_COUNT_HW_CPU_CYCLES, PERF_COUNT_HW_INSTRUCTIONS,
+                                 PERF_COUNT_HW_BRANCH_MISSES, PERF_COUNT_HW_CACHE_MISSES};
+    for (size_t i = 0; i < fds.size(); ++i) {
+      perf_event_attr attr{};
+      attr.type = PERF_TYPE_HARDWARE;
+      attr.size = sizeof(attr);
+      attr.config = configs[i];
+      attr.disabled = i == 0; // The leader starts and stops the group.
+      attr.exclude_kernel = 1;
+      attr.exclude_hv = 1;
+      attr.read_format = PERF_FORMAT_GROUP;
+      fds[i] = syscall(SYS_perf_event_open, &attr, 0, -1, i ? fds[0] : -1, 0);
+      if (fds[i] == -1) {
+        close();
+        return;
+      }
+    }
+#endif
+  }
+
+  hardware_counters(const hardware_counters &) = delete;
+  hardware_counters &operator=(const hardware_counters &) = delete;
+  ~hardware_counters() { close(); }
+
+  void close() noexcept {
+    for (auto &fd : fds) {
+      if (fd != -1) {
+        ::close(fd);
+        fd = -1;
+      }
+    }
+  }
+
+  [[nodiscard]] bool available() const noexcept { return fds[0] != -1; }
+
+  void start() noexcept {
+#ifdef __linux__
+    if (available()) {
+      ioctl(fds[0], PERF_EVENT_IOC_RESET, PERF_IOC_FLAG_GROUP);
+      ioctl(fds[0], PERF_EVENT_IOC_ENABLE, PERF_IOC_FLAG_GROUP);
+    }
+#endif
+  }
+
+  /** What was counted since `start`; all zero when unavailable. */
+  values stop() noexcept {
+    values counted{};
+#ifdef __linux__
+    if (available()) {
+      ioctl(fds[0], PERF_EVENT_IOC_DISABLE, PERF_IOC_FLAG_GROUP);
+      std::array<uint64_t, 1 + names.size()> group; // The number of events, then each value.
+      if (::read(fds[0], group.data(), sizeof(group)) == static_cast<ssize_t>(sizeof(group))) {
+        std::ranges::copy(std::span(group).subspan(1), counted.begin());
+      }
+    }
+#endif
+    return counted;
+  }
+};
+
+/** A benchmark as measured, or as read back from a file: per operation, NaN where unknown. */
+struct measurement {
+  std::string name;
+  double ns;
+  std::array<double, hardware_counters::names.size()> counters;
+};
+
+/** A move to try on a position of the corpus, with the piece on its source square. */
+struct candidate {
+  uint32_t position;
+  piece p;
+  move m;
+};
+
+/**
+ * Every legal move of every position, and as many that are not: each legal move with its
+ * destination a rank away, which some pieces reach and others do not, for a mix of the reasons
+ * to reject a move.
+ */
+std::vector<candidate> candidates(const std::vector<configuration> &positions) {
+  std::vector<candidate> found;
+  for (uint32_t i = 0; i < positions.size(); ++i) {
+    const auto &config = positions[i];
+    const auto &us = config.is_white_turn() ? config.get_white() : config.get_black();
+    for (const auto m : config.generate_legal_moves()) {
+      const auto src = m.get_src_square();
+      found.emplace_back(i, us.get(src), m);
+      found.emplace_back(i, us.get(src), move(src, m.get_dst_square() ^ 8, m.get_promotion()));
+    }
+  }
+  return found;
+}
+
+class bench {
+  const unsigned samples;
+  const std::chrono::nanoseconds sample_time;
+  hardware_counters hardware;
+  uint64_t total = 0;
+
+public:
+  std::vector<measurement> results;
+
+  bench(const unsigned samples, const std::chrono::nanoseconds sample_time)
+      : samples(samples), sample_time(sample_time) {}
+
+  [[nodiscard]] uint64_t checksum() const noexcept { return total; }
+  [[nodiscard]] bool has_hardware_counters() const noexcept { return hardware.available(); }
+
+  /**
+   * Times `pass`, which does `ops` operations and returns a value depending on all of them. Each
+   * sample repeats it for at least the sample time, and the fastest sample stands: the others
+   * lost time to interruptions, not to the code.
+   */
+  void run(const std::string_view name, const uint64_t ops, auto &&pass) {
+    measurement best{std::string(name), INFINITY, {}};
+    best.counters.fill(NAN);
+    const auto counted_before = hot_path::collect();
+    uint64_t total_ops = 0;
+    for (unsigned sample = 0; sample < samples; ++sample) {
+      uint64_t passes = 0;
+      std::chrono::nanoseconds elapsed{};
+      const auto start = std::chrono::steady_clock::now();
+      hardware.start();
+      do {
+        total += pass();
+        ++passes;
+        elapsed = std::chrono::steady_clock::now() - start;
+      } while (elapsed < sample_time);
+      const auto counted = hardware.stop();
+      const auto n = static_cast<double>(passes * ops);
+      total_ops += passes * ops;
+      if (const auto ns = elapsed.count() / n; ns < best.ns) {
+        best.ns = ns;
+        for (size_t i = 0; hardware.available() && i < counted.size(); ++i) {
+          best.counters[i] = counted[i] / n;
+        }
+      }
+    }
+    std::cout << name << ": " << best.ns << " ns";
+    for (size_t i = 0; i < best.counters.size(); ++i) {
+      if (!std::isnan(best.counters[i])) {
+        std::cout << ", " << best.counters[i] << ' ' << hardware_counters::names[i];
+      }
+    }
+    std::cout << " per op\n";
+    if constexpr (hot_path::enabled) {
+      const auto counted = hot_path::collect();
+      for (size_t i = 0; i < counted.size(); ++i) {
+        if (const auto n = counted[i] - counted_before[i]) {
+          std::cout << "  " << hot_path::names[i] << ": "
+                    << static_cast<double>(n) / static_cast<double>(total_ops) << " per op\n";
+        }
+      }
+    }
+    results.push_back(std::move(best));
+  }
+};
+
+/** Whether every kernel of `attack_batch` agrees with `configuration::in_check` on `positions`. */
+bool check_batches(const std::vector<configuration> &positions) {
+  attack_batch::positions batch;
+  for (const auto &config : positions) {
+    batch.push_back(config);
+  }
+  std::vector<uint64_t> found(batch.padded_size());
+  bool ok = true;
+  for (const auto set : {isa::scalar, isa::avx2, isa::avx512}) {
+    if (!attack_batch::supported(set)) {
+      continue;
+    }
+    attack_batch::attackers(batch, found, set);
+    size_t mismatches = 0;
+    for (size_t i = 0; i < positions.size(); ++i) {
+      mismatches += (found[i] != 0) != positions[i].in_check();
+    }
+    if (mismatches) {
+      std::cout << "attack_batch " << isa_names[std::to_underlying(set)] << ": " << mismatches
+                << " mismatches with configuration::in_check\n";
+      ok = false;
+    }
+  }
+  return ok;
+}
+
+/** Runs every benchmark; whether the batched kernels agree with the per-position code. */
+bool run(bench &b) {
+  const auto positions = corpus<side>();
+  const auto tries = candidates(positions);
+  uint64_t pieces = 0;
+  for (const auto &config : positions) {
+    pieces += config.get_white().size() + config.get_black().size();
+  }
+  std::cout << positions.size() << " positions, " << tries.size() << " moves to try\n";
+
+  b.run("side::iterator", pieces, [&] {
+    uint64_t sum = 0;
+    for (const auto &config : positions) {
+      for (const auto [p, s] : config.get_white()) {
+        sum += std::to_underlying(p) ^ s;
+      }
+      for (const auto [p, s] : config.get_black()) {
+        sum += std::to_underlying(p) ^ s;
+      }
+    }
+    return sum;
+  });
+  b.run("side::get_king_square", positions.size() * 2, [&] {
+    uint64_t sum = 0;
+    for (const auto &config : positions) {
+      sum += config.get_white().get_king_square() + config.get_black().get_king_square();
+    }
+    return sum;
+  });
+  // Sliders from every square, against the occupancy of every position.
+  b.run("attacks::rook", positions.size() * 64, [&] {
+    uint64_t sum = 0;
+    for (const auto &config : positions) {
+      const auto occupied = config.get_white().get_occupancy() | config.get_black().get_occupancy();
+      for (int s = 0; s < 64; ++s) {
+        sum ^= attacks::rook(s, occupied);
+      }
+    }
+    return sum;
+  });
+  b.run("attacks::bishop", positions.size() * 64, [&] {
+    uint64_t sum = 0;
+    for (const auto &config : positions) {
+      const auto occupied = config.get_white().get_occupancy() | config.get_black().get_occupancy();
+      for (int s = 0; s < 64; ++s) {
+        sum ^= attacks::bishop(s, occupied);
+      }
+    }
+    return sum;
+  });
+  b.run("configuration::in_check", positions.size(), [&] {
+    uint64_t sum = 0;
+    for (const auto &config : positions) {
+      sum += config.in_check();
+    }
+    return sum;
+  });
+  // The same question for the whole corpus at once: laying it out by field, then each kernel.
+  const bool ok = check_batches(positions);
+  attack_batch::positions batch;
+  b.run("attack_batch::positions::push_back", positions.size(), [&] {
+    batch.clear();
+    for (const auto &config : positions) {
+      batch.push_back(config);
+    }
+    return batch.size();
+  });
+  std::vector<uint64_t> bits((batch.size() + 63) / 64);
+  constexpr std::array<std::string_view, 3> kernels{"attack_batch::attacked scalar",
+                                                    "attack_batch::attacked avx2",
+                                                    "attack_batch::attacked avx512"};
+  for (const auto set : {isa::scalar, isa::avx2, isa::avx512}) {
+    if (attack_batch::supported(set)) {
+      b.run(kernels[std::to_underlying(set)], batch.size(), [&] {
+        attack_batch::attacked(batch, bits, set);
+        return bits[0];
+      });
+    }
+  }
+  b.run("configuration::test_move", tries.size(), [&] {
+    uint64_t sum = 0;
+    for (const auto &[i, p, m] : tries) {
+      sum += positions[i].test_move(p, m);
+    }
+    return sum;
+  });
+  b.run("configuration::try_move", tries.size(), [&] {
+    uint64_t sum = 0;
+    for (const auto &[i, p, m] : tries) {
+      sum += positions[i].try_move(p, m).has_value();
+    }
+    return sum;
+  });
+  return ok;
+}
+
+/**
+ * One line per benchmark, tab-separated: its name, then nanoseconds, cycles, instructions, branch
+ * misses and cache misses per operation, '-' where unknown. Lines starting with '#' are comments.
+ */
+bool write_results(const char *const path, const std::vector<measurement> &results) {
+  std::ofstream out(path);
+  out << "# name\tns";
+  for (const auto name : hardware_counters::names) {
+    out << '\t' << name;
+  }
+  out << '\n';
+  for (const auto &r : results) {
+    out << r.name << '\t' << r.ns;
+    for (const auto c : r.counters) {
+      if (std::isnan(c)) {
+        out << "\t-";
+      } else {
+        out << '\t' << c;
+      }
+    }
+    out << '\n';
+  }
+  out.close();
+  return !out.fail();
+}
+
+std::optional<std::vector<measurement>> read_results(const char *const path) {
+  std::ifstream in(path);
+  if (!in) {
+    std::perror(path);
+    return std::nullopt;
+  }
+  std::vector<measurement> results;
+  for (std::string line; std::getline(in, line);) {
+    if (line.empty() || line[0] == '#') {
+      continue;
+    }
+    // Split on tabs, as names may hold spaces.
+    std::istringstream fields(line);
+    measurement m{};
+    if (!std::getline(fields, m.name, '\t') || !(fields >> m.ns)) {
+      std::cerr << path << ": not a benchmark: " << line << '\n';
+      return std::nullopt;
+    }
+    for (auto &c : m.counters) {
+      std::string field;
+      fields >> field;
+      c = field.empty() || field == "-" ? NAN : std::strtod(field.c_str(), nullptr);
+    }
+    results.push_back(std::move(m));
+  }
+  return results;
+}
+
+/** Prints how each benchmark changed; whether none got slower by more than `percent`. */
+bool compare(const std::vector<measurement> &before, const std::vector<measurement> &after,
+             const unsigned percent) {
+  bool ok = true;
+  for (const auto &a : after) {
+    const auto b = std::ranges::find(before, a.name, &measurement::name);
+    if (b == before.end()) {
+      std::cout << a.name << ": new\n";
+      continue;
+    }
+    const auto change = (a.ns / b->ns - 1) * 100;
+    const bool regressed = change > percent;
+    ok &= !regressed;
+    std::cout << a.name << ": " << b->ns << " -> " << a.ns << " ns, " << std::showpos << change
+              << std::noshowpos << '%';
+    // Instructions do not vary from run to run as time does; a change in them is a change in code.
+    constexpr size_t instructions = 1;
+    if (!std::isnan(a.counters[instructions]) && !std::isnan(b->counters[instructions])) {
+      std::cout << ", instructions " << b->counters[instructions] << " -> "
+                << a.counters[instructions];
+    }
+    std::cout << (regressed ? "  REGRESSION\n" : "\n");
+  }
+  return ok;
+}
+
+// bench [-s samples] [-t milliseconds] [-o file] [-c baseline] [-r percent]
+//   Times each primitive over the corpus, the fastest of the samples of at least the given time,
+//   5 of 200 ms by default, and prints nanoseconds and hardware counters per operation, and, in a
+//   build with -DHOT_PATH_COUNTERS, the hot path counters per operation. -o writes the results
+//   to a file; -c compares them with a file written before, flagging every benchmark slower by
+//   more than -r percent, 5 by default, and exits with 1 if there is one.
+// bench -c baseline [-r percent] file
+//   Compares two files written before, without running anything.
+int main(const int argc, char *const argv[]) {
+  std::cin.tie(nullptr)->sync_with_stdio(false);
+  unsigned samples = 5, percent = 5;
+  std::chrono::milliseconds::rep milliseconds = 200;
+  const char *output = nullptr, *baseline = nullptr;
+  bool usage = false;
+  for (int opt; (opt = getopt(argc, argv, "s:t:o:c:r:")) != -1;) {
+    switch (opt) {
+    case 's':
+      usage |= !parse(optarg, samples) || samples == 0;
+      break;
+    case 't':
+      usage |= !parse(optarg, milliseconds);
+      break;
+    case 'o':
+      output = optarg;
+      break;
+    case 'c':
+      baseline = optarg;
+      break;
+    case 'r':
+      usage |= !parse(optarg, percent);
+      break;
+    default:
+      usage = true;
+    }
+  }
+  const bool offline = optind + 1 == argc;
+  if (usage || optind + offline != argc || (offline && (!baseline || output))) {
+    std::cerr << "usage: " << argv[0]
+              << " [-s samples] [-t milliseconds] [-o file] [-c baseline] [-r percent]\n"
+              << "       " << argv[0] << " -c baseline [-r percent] file\n";
+    return 2;
+  }
+  const auto before = baseline ? read_results(baseline) : std::nullopt;
+  if (baseline && !before) {
+    return 1;
+  }
+  if (offline) {
+    const auto after = read_results(argv[optind]);
+    return after && compare(*before, *after, percent) ? 0 : 1;
+  }
+
+  bench b(samples, std::chrono::milliseconds(milliseconds));
+  if (!b.has_hardware_counters()) {
+    std::cout << "no hardware counters\n";
+  }
+  const bool ok = run(b);
+  std::cout << "checksum " << b.checksum() << std::endl;
+  if (output && !write_results(output, b.results)) {
+    std::perror(output);
+    return 1;
+  }
+  if (output) {
+    // What -c reads must be what was written, names with spaces included.
+    const auto written = read_results(output);
+    if (!written || !std::ranges::equal(*written, b.results, {}, &measurement::name,
+                                        &measurement::name)) {
+      std::cerr << output << ": does not read back\n";
+      return 1;
+    }
+  }
+  return !ok || (before && !compare(*before, b.results, percent)) ? 1 : 0;
+}
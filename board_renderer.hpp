@@ -0,0 +1,143 @@
+#pragma once
+#include "ansi_escape_code.hpp"
+#include "chess.hpp"
+#include <algorithm>
+#include <array>
+#include <cassert>
+#include <cerrno>
+#include <string_view>
+#include <unistd.h>
+
+/**
+ * Draws boards at a fixed place of a terminal. The first frame paints the whole board with its
+ * file and rank hints; every later one repaints only the squares whose piece changed since, each
+ * after a cursor position. A frame is built in a buffer of its own and written with one
+ * write(2), and the cursor is left where it was.
+ */
+class board_renderer {
+  // A square as drawn: its piece, plus 8 if white; `unknown` before the first frame.
+  static constexpr uint8_t unknown = 0xFF;
+
+  static constexpr auto hint_color = "\033[0;49;90m";
+  static constexpr std::string_view file_hint = "　ａｂｃｄｅｆｇｈ　";
+  static constexpr std::array<std::string_view, 8> rank_hints{
+      "８", "７", "６", "５", "４", "３", "２", "１",
+  };
+  // By the piece, then by whether it is white. Each glyph is two columns wide.
+  static constexpr std::array<std::array<std::string_view, 2>, 7> glyphs{{
+      {"　", "　"},
+      {"ｐ", "Ｐ"},
+      {"ｒ", "Ｒ"},
+      {"ｎ", "Ｎ"},
+      {"ｂ", "Ｂ"},
+      {"ｑ", "Ｑ"},
+      {"ｋ", "Ｋ"},
+  }};
+  static constexpr std::array foregrounds{
+      ansi::foreground_bright(ansi::color::green),
+      ansi::foreground_bright(ansi::color::white),
+  };
+  static constexpr std::array backgrounds{
+      ansi::background_bright(ansi::color::blue),
+      ansi::background_dark(ansi::color::blue),
+  };
+
+  // A full frame takes about 1.5 KiB: 64 squares of at most 22 bytes, and the hints.
+  std::array<char, 4096> buffer;
+  size_t size = 0;
+  std::array<uint8_t, 64> shown; // By square as displayed, a8 first.
+  int fd;
+  uint8_t row, col;
+
+  void append(const std::string_view s) noexcept {
+    assert(size + s.size() <= buffer.size());
+    std::ranges::copy(s, buffer.begin() + size);
+    size += s.size();
+  }
+
+  /** Writes the frame, however many calls a slow terminal needs; whether all of it went out. */
+  bool flush() noexcept {
+    size_t written = 0;
+    while (written < size) {
+      const auto n = ::write(fd, buffer.data() + written, size - written);
+      if (n < 0 && errno == EINTR) {
+        continue;
+      }
+      if (n <= 0) {
+        break;
+      }
+      written += n;
+    }
+    const bool ok = written == size;
+    size = 0;
+    return ok;
+  }
+
+public:
+  /** Draws on `fd` with the top left corner of the board at `row` and `col`, both 1-based. */
+  explicit board_renderer(const int fd = STDOUT_FILENO, const uint8_t row = 1,
+                          const uint8_t col = 1) noexcept
+      : fd(fd), row(row), col(col) {
+    invalidate();
+  }
+
+  /** Makes the next frame a full one, as after the screen was cleared. */
+  void invalidate() noexcept { shown.fill(unknown); }
+
+  /** Draws `config`; whether the frame was written whole, the next one being full if not. */
+  template <class Side> bool draw(const basic_configuration<Side> &config) noexcept {
+    std::array<uint8_t, 64> board{};
+    for (const auto [p, s] : config.get_white()) {
+      board[63 ^ s] = std::to_underlying(p) | 8;
+    }
+    for (const auto [p, s] : config.get_black()) {
+      board[63 ^ s] = std::to_underlying(p);
+    }
+    const bool full = shown[0] == unknown;
+    append(ansi::cursor_save);
+    if (full) {
+      append(ansi::cursor_position(row, col));
+      append(hint_color);
+      append(file_hint);
+      append(ansi::cursor_position(row + 9, col));
+      append(file_hint);
+      for (uint8_t rank = 0; rank < 8; ++rank) {
+        append(ansi::cursor_position(row + 1 + rank, col));
+        append(rank_hints[rank]);
+        append(ansi::cursor_position(row + 1 + rank, col + 18));
+        append(rank_hints[rank]);
+      }
+    }
+    // Attributes are only sent when they change from one square to the next.
+    int foreground = -1, background = -1;
+    size_t cursor = 64; // The square the cursor is on, if any.
+    for (size_t i = 0; i < 64; ++i) {
+      if (board[i] == shown[i]) {
+        continue;
+      }
+      // Squares of the same row follow each other without moving the cursor.
+      if (i != cursor || i % 8 == 0) {
+        append(ansi::cursor_position(row + 1 + i / 8, col + 2 + 2 * (i % 8)));
+      }
+      cursor = i + 1;
+      const bool is_white = board[i] & 8;
+      if (const int b = (i / 8 + i % 8) % 2; b != background) {
+        append(backgrounds[b]);
+        background = b;
+      }
+      if (is_white != foreground) {
+        append(foregrounds[is_white]);
+        foreground = is_white;
+      }
+      append(glyphs[board[i] & 7][is_white]);
+      shown[i] = board[i];
+    }
+    append(ansi::reset);
+    append(ansi::cursor_restore);
+    if (!flush()) {
+      invalidate(); // What the terminal shows is anyone's guess.
+      return false;
+    }
+    return true;
+  }
+};
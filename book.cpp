@@ -0,0 +1,136 @@
+// Builds an opening book from the games of a PGN file, and looks positions up in one.
+#include "arguments.hpp"
+#include "book.hpp"
+#include "chess.hpp"
+#include "fen.hpp"
+#include "pgn.hpp"
+#include "uci.hpp"
+#include <chrono>
+#include <iostream>
+#include <thread>
+#include <unistd.h>
+#include <vector>
+
+/**
+ * Every move of the first `plies` of every game, weighted as Polyglot weighs them: 2 for a move
+ * of the winner, 1 for either side in a draw, and nothing for the loser or an unknown result.
+ */
+int build(const char *const book, const char *const games, const unsigned threads,
+          const unsigned plies) {
+  const auto file = pgn_file::open(games);
+  if (!file) {
+    return 1;
+  }
+  const auto start = std::chrono::steady_clock::now();
+  std::vector<std::vector<book_entry>> found(threads); // By worker.
+  const auto stats = parallel_import(file->text(), threads, [&](const unsigned self,
+                                                                const pgn_game &game) {
+    auto config = game.start;
+    for (const auto m : game.moves.first(std::min<size_t>(plies, game.moves.size()))) {
+      const auto winner = config.is_white_turn() ? outcome::white_wins : outcome::black_wins;
+      const uint16_t weight = game.result == winner ? 2 : game.result == outcome::draw ? 1 : 0;
+      if (weight) {
+        found[self].emplace_back(book_key(config), encode_book_move(config, m), weight);
+      }
+      config = config.play(m);
+    }
+  });
+  std::vector<book_entry> entries;
+  for (const auto &f : found) {
+    entries.insert(entries.end(), f.begin(), f.end());
+  }
+  if (!write_book(book, entries)) {
+    std::perror(book);
+    return 1;
+  }
+  const std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+  const auto written = opening_book::open(book);
+  std::cout << stats.games << " games, " << stats.rejected << " rejected: " << entries.size()
+            << " moves into " << (written ? written->entries().size() : 0) << " entries in "
+            << elapsed.count() << " s" << std::endl;
+  return 0;
+}
+
+/** The book moves of `config` with their weights; with `timing`, how long a lookup takes. */
+int list(const opening_book &book, const configuration &config, const bool timing,
+         const uint64_t seed) {
+  for (const auto &e : book.find(config)) {
+    if (const auto m = decode_book_move(config, e.get_move())) {
+      std::cout << *m << ' ' << e.get_weight() << '\n';
+    }
+  }
+  const auto best = book.best(config);
+  const auto picked = book.pick(config, seed);
+  std::cout << "best " << (best ? *best : move(0, 0)) << ", picked "
+            << (picked ? *picked : move(0, 0)) << '\n';
+  if (timing) {
+    // Lookups of the position and of those its book moves lead to, round and round.
+    std::vector<configuration> configs{config};
+    for (const auto &e : book.find(config)) {
+      if (const auto m = decode_book_move(config, e.get_move())) {
+        configs.push_back(config.play(*m));
+      }
+    }
+    constexpr size_t n = 1'000'000;
+    size_t hits = 0;
+    const auto start = std::chrono::steady_clock::now();
+    for (size_t i = 0; i < n; ++i) {
+      hits += book.best(configs[i % configs.size()]).has_value();
+    }
+    const std::chrono::duration<double, std::micro> elapsed =
+        std::chrono::steady_clock::now() - start;
+    std::cout << n << " lookups in " << book.entries().size() << " entries, " << hits
+              << " hits: " << elapsed.count() / n << " us each\n";
+  }
+  std::cout << std::flush;
+  return 0;
+}
+
+// book -w [-j threads] [-p plies] book games
+//   Builds a book from the first plies of every game of a PGN file, 24 by default.
+// book [-t] [-r seed] book [fen]
+//   Lists the book moves of the position, the initial one by default, with their weights, the
+//   best one and one drawn by weight with the seed; -t times lookups.
+int main(const int argc, char *const argv[]) {
+  std::cin.tie(nullptr)->sync_with_stdio(false);
+  unsigned threads = std::max(std::thread::hardware_concurrency(), 1U), plies = 24;
+  uint64_t seed = 0;
+  bool writing = false, timing = false, usage = false;
+  for (int opt; (opt = getopt(argc, argv, "wj:p:tr:")) != -1;) {
+    switch (opt) {
+    case 'w':
+      writing = true;
+      break;
+    case 'j':
+      usage |= !parse(optarg, threads) || threads == 0;
+      break;
+    case 'p':
+      usage |= !parse(optarg, plies);
+      break;
+    case 't':
+      timing = true;
+      break;
+    case 'r':
+      usage |= !parse(optarg, seed);
+      break;
+    default:
+      usage = true;
+    }
+  }
+  const auto operands = argc - optind;
+  const auto root = !writing && operands == 2 ? parse_fen(argv[optind + 1]) : configuration();
+  if (usage || !root || (writing ? operands != 2 : operands < 1 || operands > 2)) {
+    std::cerr << "usage: " << argv[0] << " -w [-j threads] [-p plies] book games\n"
+              << "       " << argv[0] << " [-t] [-r seed] book [fen]\n";
+    return 2;
+  }
+  if (writing) {
+    return build(argv[optind], argv[optind + 1], threads, plies);
+  }
+  const auto book = opening_book::open(argv[optind]);
+  if (!book) {
+    return 1;
+  }
+  // The seed is spread over all 64 bits, as `pick` expects.
+  return list(*book, *root, timing, (seed + 1) * 0x9E37'79B9'7F4A'7C15);
+}
@@ -1,10 +1,15 @@
 #pragma once
+#include "hot_path.hpp"
 #include <algorithm>
 #include <array>
+#include <bit>
 #include <cassert>
 #include <cstdlib>
 #include <ranges>
 #include <utility>
+#ifdef __BMI2__
+#include <immintrin.h>
+#endif
 
 using square = unsigned _BitInt(6);
 
@@ -39,6 +44,17 @@ class side {
   }
 
 public:
+  static constexpr side empty() noexcept { return {}; }
+  /** The side laid out as `occupancy` and `pieces`, the values of the two getters below. */
+  static constexpr side from(const uint64_t occupancy, const uint64_t pieces) noexcept {
+    // One nibble per piece, and no more than 16 of them.
+    assert(std::popcount(occupancy) <= 16 &&
+           std::bit_width(pieces) <= 4 * std::popcount(occupancy));
+    side side;
+    side.occupancy = occupancy;
+    side.pieces = pieces;
+    return side;
+  }
   static constexpr side initial_black() noexcept {
     return initial(side::initial_rank1, side::initial_rank2, side::initial_rank3);
   }
@@ -52,14 +68,83 @@ private:
 
 public:
   [[nodiscard]] constexpr auto get_occupancy() const noexcept { return occupancy; }
+  /** One nibble per occupied square, the lowest square in the lowest nibble. */
+  [[nodiscard]] constexpr auto get_pieces() const noexcept { return pieces; }
 
-  [[nodiscard]] constexpr auto get_king_square() const noexcept {
-    for (const auto [piece, shift] : *this) {
-      if (piece == piece::king) {
-        return shift;
+  /** The squares holding `p`, which MUST NOT be `piece::empty`. */
+  [[nodiscard]] constexpr uint64_t get_bitboard(const piece p) const noexcept {
+    // Nibbles equal to `p` become zero; fold each nibble onto its lowest bit to find them.
+    constexpr uint64_t lows = 0x1111'1111'1111'1111;
+    auto x = pieces ^ (lows * std::to_underlying(p));
+    x |= x >> 1;
+    x |= x >> 2;
+    const auto matches = ~x & lows;
+#ifdef __BMI2__
+    if !consteval {
+      return _pdep_u64(_pext_u64(matches, lows), occupancy);
+    }
+#endif
+    uint64_t bitboard = 0;
+    for (auto o = occupancy, m = matches; o; o &= o - 1, m >>= 4) {
+      if (m & 1) {
+        bitboard |= o & -o;
       }
     }
-    assert(false); // FIXME: std::unreachable();
+    return bitboard;
+  }
+
+  [[nodiscard]] constexpr square get_king_square() const noexcept {
+    hot_path::count(hot_path::event::king_square);
+    // There is exactly 1 king for each side.
+    return std::countr_zero(get_bitboard(piece::king));
+  }
+
+  /** The piece on `s`, if any. Its nibble is ranked by the occupied squares below `s`. */
+  [[nodiscard]] constexpr piece get(const square s) const noexcept {
+    const auto bit = uint64_t{1} << s;
+    if (!(occupancy & bit)) {
+      return piece::empty;
+    }
+    const auto rank = std::popcount(occupancy & (bit - 1));
+    return static_cast<piece>((pieces >> (4 * rank)) & 0xF);
+  }
+
+  /** Places `p` on the empty square `s`, shifting the nibbles of all higher squares up. */
+  constexpr void insert(const piece p, const square s) noexcept {
+    const auto bit = uint64_t{1} << s;
+    assert(!(occupancy & bit) && p != piece::empty && size() < 16);
+    const auto rank = std::popcount(occupancy & (bit - 1));
+    const auto hole = uint64_t{0xF} << (4 * rank);
+    const auto nibble = static_cast<uint64_t>(std::to_underlying(p)) << (4 * rank);
+#ifdef __BMI2__
+    if !consteval {
+      pieces = _pdep_u64(pieces, ~hole) ^ nibble;
+      occupancy ^= bit;
+      return;
+    }
+#endif
+    const auto below = (uint64_t{1} << (4 * rank)) - 1;
+    pieces = ((pieces & ~below) << 4) ^ nibble ^ (pieces & below);
+    occupancy ^= bit;
+  }
+
+  /** Removes and returns the piece on the occupied square `s`. */
+  constexpr piece erase(const square s) noexcept {
+    const auto bit = uint64_t{1} << s;
+    assert(occupancy & bit);
+    const auto rank = std::popcount(occupancy & (bit - 1));
+    const auto hole = uint64_t{0xF} << (4 * rank);
+    const auto p = static_cast<piece>((pieces & hole) >> (4 * rank));
+    occupancy ^= bit;
+#ifdef __BMI2__
+    if !consteval {
+      pieces = _pext_u64(pieces, ~hole);
+      return p;
+    }
+#endif
+    const auto below = (uint64_t{1} << (4 * rank)) - 1;
+    pieces = ((pieces >> 4) & ~below) ^ (pieces & below);
+    return p;
   }
 
   class iterator {
@@ -79,6 +164,7 @@ public:
     }
 
     constexpr iterator &operator++() {
+      hot_path::count(hot_path::event::iterator_step);
       occupancy ^= occupancy & -occupancy; // Clear lowest set bit.
       pieces >>= 4;
       return *this;
@@ -100,83 +186,631 @@ public:
 
 static_assert(std::ranges::sized_range<side>);
 
-class move {
-  int src_square, dst_square;
+/**
+ * The same interface as `side`, laid out as one bitboard per piece type plus the king square. It
+ * takes 64 bytes instead of 16, but finding the knights is a load rather than a decode.
+ */
+class wide_side {
+  std::array<uint64_t, 7> bitboards{}; // By piece; the slot of `piece::empty` holds the occupancy.
+  square king{};
 
-  template <uint64_t L, uint64_t R = L>
-  [[nodiscard]] constexpr uint64_t straight_path() const noexcept {
-    if (src_square < dst_square) {
-      return (L << src_square) ^ (L << dst_square);
-    } else {
-      return (R >> (63 ^ src_square)) ^ (R >> (63 ^ dst_square));
-      // static_assert((63 - x) == (63 ^ x)); // forall 0 <= x < 64
+  constexpr wide_side() noexcept = default;
+
+public:
+  static constexpr wide_side empty() noexcept { return {}; }
+  /** The same pieces on the same squares as `compact`. */
+  static constexpr wide_side from(const side &compact) noexcept {
+    wide_side wide;
+    for (const auto [piece, square] : compact) {
+      wide.insert(piece, square);
+    }
+    return wide;
+  }
+  static constexpr wide_side from(const uint64_t occupancy, const uint64_t pieces) noexcept {
+    return from(side::from(occupancy, pieces));
+  }
+  static constexpr wide_side initial_black() noexcept { return from(side::initial_black()); }
+  static constexpr wide_side initial_white() noexcept { return from(side::initial_white()); }
+
+  [[nodiscard]] constexpr auto get_occupancy() const noexcept { return bitboards[0]; }
+  [[nodiscard]] constexpr uint64_t get_bitboard(const piece p) const noexcept {
+    return bitboards[std::to_underlying(p)];
+  }
+  [[nodiscard]] constexpr square get_king_square() const noexcept { return king; }
+
+  [[nodiscard]] constexpr piece get(const square s) const noexcept {
+    const auto bit = uint64_t{1} << s;
+    for (const auto p : {piece::pawn, piece::rook, piece::knight, piece::bishop, piece::queen,
+                         piece::king}) {
+      if (get_bitboard(p) & bit) {
+        return p;
+      }
     }
+    return piece::empty;
   }
 
+  constexpr void insert(const piece p, const square s) noexcept {
+    const auto bit = uint64_t{1} << s;
+    assert(!(get_occupancy() & bit) && p != piece::empty);
+    bitboards[0] ^= bit;
+    bitboards[std::to_underlying(p)] ^= bit;
+    if (p == piece::king) {
+      king = s;
+    }
+  }
+
+  constexpr piece erase(const square s) noexcept {
+    const auto p = get(s);
+    assert(p != piece::empty);
+    const auto bit = uint64_t{1} << s;
+    bitboards[0] ^= bit;
+    bitboards[std::to_underlying(p)] ^= bit;
+    return p;
+  }
+
+  /** Visits the pieces type by type, each type from the lowest square up. */
+  class iterator {
+    const std::array<uint64_t, 7> *bitboards;
+    int p = 0;
+    uint64_t remaining = 0;
+
+    constexpr void skip_exhausted() noexcept {
+      while (remaining == 0 && p < std::to_underlying(piece::king)) {
+        remaining = (*bitboards)[++p];
+      }
+    }
+
+  public:
+    using difference_type = std::ptrdiff_t;
+    using value_type = side::iterator::value_type;
+
+    constexpr iterator(const wide_side &side) : bitboards(&side.bitboards) { skip_exhausted(); }
+
+    constexpr value_type operator*() const noexcept {
+      return value_type(static_cast<piece>(p), std::countr_zero(remaining));
+    }
+
+    constexpr iterator &operator++() {
+      remaining &= remaining - 1;
+      skip_exhausted();
+      return *this;
+    }
+
+    constexpr iterator operator++(int) {
+      auto old = *this;
+      ++*this;
+      return old;
+    }
+
+    constexpr bool operator==(std::default_sentinel_t) const noexcept { return remaining == 0; }
+  };
+
+  [[nodiscard]] constexpr iterator begin() const noexcept { return *this; };
+  [[nodiscard]] constexpr std::default_sentinel_t end() const noexcept { return {}; };
+  [[nodiscard]] constexpr size_t size() const noexcept { return std::popcount(get_occupancy()); };
+};
+
+static_assert(std::ranges::sized_range<wide_side>);
+
+class move {
+  int src_square, dst_square;
+  piece promotion;
+
 public:
-  constexpr move(const square src_square, const square dst_square) noexcept
-      : src_square(src_square), dst_square(dst_square) {}
+  // Trivial, so that a `move_list` is not zeroed on construction.
+  constexpr move() noexcept = default;
+  constexpr move(const square src_square, const square dst_square,
+                 const piece promotion = piece::empty) noexcept
+      : src_square(src_square), dst_square(dst_square), promotion(promotion) {}
+
+  constexpr bool operator==(const move &) const noexcept = default;
+
+  [[nodiscard]] constexpr square get_src_square() const noexcept { return src_square; }
+  [[nodiscard]] constexpr square get_dst_square() const noexcept { return dst_square; }
+  /** The piece a pawn turns into on the last rank; otherwise `piece::empty`. */
+  [[nodiscard]] constexpr piece get_promotion() const noexcept { return promotion; }
 
   [[nodiscard]] constexpr uint64_t src() const noexcept { return uint64_t{1} << src_square; }
   [[nodiscard]] constexpr uint64_t src(const uint64_t mask) const noexcept { return mask & src(); }
-  [[nodiscard]] constexpr uint64_t src(const side side) const noexcept {
+  [[nodiscard]] constexpr uint64_t src(const auto &side) const noexcept {
     return src(side.get_occupancy());
   }
 
   [[nodiscard]] constexpr uint64_t dst() const noexcept { return uint64_t{1} << dst_square; }
   [[nodiscard]] constexpr uint64_t dst(const uint64_t mask) const noexcept { return mask & dst(); }
-  [[nodiscard]] constexpr uint64_t dst(const side side) const noexcept {
+  [[nodiscard]] constexpr uint64_t dst(const auto &side) const noexcept {
     return dst(side.get_occupancy());
   }
 
   [[nodiscard]] constexpr uint64_t exclude_dst_from(uint64_t mask) const noexcept {
     return mask & ~dst();
   }
+};
 
-  /** Returns rank-difference followed by file-difference. */
-  [[nodiscard]] constexpr auto diff() const noexcept {
-    return std::div(dst_square - src_square, 8);
+/** Fixed-capacity list of moves; no position has more than 218 legal moves. */
+class move_list {
+  std::array<move, 256> moves;
+  size_t count = 0;
+
+public:
+  constexpr void push_back(const move m) noexcept {
+    assert(count < moves.size());
+    moves[count++] = m;
   }
 
-  /** The four cardinal directions: north, south, east, and west. */
-  [[nodiscard]] constexpr std::optional<uint64_t> cardinal_path() const noexcept {
-    const auto [rank_diff, file_diff] = diff();
-    if (rank_diff == 0) { // same rank
-      constexpr uint64_t full = 0xFFFF'FFFF'FFFF'FFFF;
-      return straight_path<full>();
+  [[nodiscard]] constexpr auto begin() const noexcept { return moves.begin(); }
+  [[nodiscard]] constexpr auto end() const noexcept { return moves.begin() + count; }
+  [[nodiscard]] constexpr size_t size() const noexcept { return count; }
+  [[nodiscard]] constexpr bool empty() const noexcept { return count == 0; }
+  [[nodiscard]] constexpr move operator[](const size_t i) const noexcept { return moves[i]; }
+  [[nodiscard]] constexpr move &operator[](const size_t i) noexcept { return moves[i]; }
+};
+
+/**
+ * Which legal moves to generate: all of them, or only the noisy ones that capture or promote, or
+ * only the quiet rest. Searches look at the noisy moves first and often need no others.
+ */
+enum class move_kind { all, noisy, quiet };
+
+/** What it takes to undo a move besides the move itself. */
+struct ply {
+  move move;
+  piece captured;
+  uint8_t castling;
+  uint64_t en_passant;
+  uint64_t key;
+};
+
+/** The plies made so far, the latest last; deep enough for any search or game. */
+class ply_stack {
+  std::array<ply, 1024> plies;
+  size_t count = 0;
+
+public:
+  constexpr void push(const ply &p) noexcept {
+    assert(count < plies.size());
+    plies[count++] = p;
+  }
+
+  constexpr ply pop() noexcept {
+    assert(count > 0);
+    return plies[--count];
+  }
+
+  [[nodiscard]] constexpr auto begin() const noexcept { return plies.begin(); }
+  [[nodiscard]] constexpr auto end() const noexcept { return plies.begin() + count; }
+  [[nodiscard]] constexpr size_t size() const noexcept { return count; }
+  [[nodiscard]] constexpr bool empty() const noexcept { return count == 0; }
+  [[nodiscard]] constexpr const ply &back() const noexcept { return plies[count - 1]; }
+};
+
+/**
+ * Precomputed attack sets, indexed by the square of the attacking piece. Squares are walked by
+ * rank and file so that no attack ever wraps around the edge of the board.
+ */
+namespace attacks {
+
+namespace impl {
+
+struct offset {
+  int rank, file;
+};
+
+constexpr auto table(auto &&offsets) noexcept {
+  std::array<uint64_t, 64> table{};
+  for (const auto s : std::views::iota(0, 64)) {
+    const auto rank = s / 8, file = s % 8;
+    for (const auto [rank_offset, file_offset] : offsets) {
+      const auto r = rank + rank_offset, f = file + file_offset;
+      if (0 <= r && r < 8 && 0 <= f && f < 8) {
+        table[s] |= uint64_t{1} << (r * 8 + f);
+      }
+    }
+  }
+  return table;
+}
+
+constexpr auto knight = table(std::array<offset, 8>{{
+    {2, 1}, {2, -1}, {-2, 1}, {-2, -1}, {1, 2}, {1, -2}, {-1, 2}, {-1, -2},
+}});
+constexpr auto king = table(std::array<offset, 8>{{
+    {1, 1}, {1, 0}, {1, -1}, {0, 1}, {0, -1}, {-1, 1}, {-1, 0}, {-1, -1},
+}});
+// White pawns advance towards higher ranks, black pawns towards lower ranks.
+constexpr auto white_pawn = table(std::array<offset, 2>{{{1, 1}, {1, -1}}});
+constexpr auto black_pawn = table(std::array<offset, 2>{{{-1, 1}, {-1, -1}}});
+
+constexpr std::array<offset, 4> rook_directions{{{1, 0}, {-1, 0}, {0, 1}, {0, -1}}};
+constexpr std::array<offset, 4> bishop_directions{{{1, 1}, {1, -1}, {-1, 1}, {-1, -1}}};
+
+/** Walks every direction up to and including the first occupied square. */
+constexpr uint64_t slide(const int s, const uint64_t occupancy, auto &&directions) noexcept {
+  uint64_t attacks = 0;
+  for (const auto [rank_offset, file_offset] : directions) {
+    auto r = s / 8 + rank_offset, f = s % 8 + file_offset;
+    for (; 0 <= r && r < 8 && 0 <= f && f < 8; r += rank_offset, f += file_offset) {
+      const auto bit = uint64_t{1} << (r * 8 + f);
+      attacks |= bit;
+      if (occupancy & bit) {
+        break;
+      }
     }
-    if (file_diff == 0) { // same file
-      constexpr uint64_t rightmost_file = 0x0101'0101'0101'0101;
-      constexpr uint64_t leftmost_file = 0x8080'8080'8080'8080;
-      return straight_path<rightmost_file, leftmost_file>();
+  }
+  return attacks;
+}
+
+/**
+ * Squares whose occupancy can change the attack set from `s`. The last square of each ray is left
+ * out; whatever stands there, it is attacked and nothing lies behind it.
+ */
+constexpr uint64_t relevant(const int s, auto &&directions) noexcept {
+  uint64_t mask = 0;
+  for (const auto [rank_offset, file_offset] : directions) {
+    auto r = s / 8 + rank_offset, f = s % 8 + file_offset;
+    for (; 0 <= r + rank_offset && r + rank_offset < 8 && 0 <= f + file_offset &&
+           f + file_offset < 8;
+         r += rank_offset, f += file_offset) {
+      mask |= uint64_t{1} << (r * 8 + f);
     }
-    return std::nullopt;
-  };
+  }
+  return mask;
+}
 
-  /** The four ordinal directions: northeast, southeast, southwest, and northwest. */
-  [[nodiscard]] constexpr std::optional<uint64_t> ordinal_path() const noexcept {
-    const auto [rank_diff, file_diff] = diff();
-    if (rank_diff == file_diff) { // northwest-southeast
-      constexpr uint64_t major_diagonal = 0x8040'2010'0804'0201;
-      return straight_path<major_diagonal>();
+struct alignment {
+  std::array<std::array<uint64_t, 64>, 64> between, line;
+};
+
+constexpr auto alignments = [] {
+  alignment a{};
+  for (const auto s : std::views::iota(0, 64)) {
+    for (const auto [rank_offset, file_offset] : std::array<offset, 8>{{
+             {1, 1}, {1, 0}, {1, -1}, {0, 1}, {0, -1}, {-1, 1}, {-1, 0}, {-1, -1},
+         }}) {
+      const std::array<offset, 2> both_ways{
+          {{rank_offset, file_offset}, {-rank_offset, -file_offset}}};
+      const auto line = uint64_t{1} << s | slide(s, 0, both_ways);
+      uint64_t between = 0;
+      auto r = s / 8 + rank_offset, f = s % 8 + file_offset;
+      for (; 0 <= r && r < 8 && 0 <= f && f < 8; r += rank_offset, f += file_offset) {
+        a.between[s][r * 8 + f] = between;
+        a.line[s][r * 8 + f] = line;
+        between |= uint64_t{1} << (r * 8 + f);
+      }
     }
-    if (rank_diff == -file_diff) { // northeast-southwest
-      constexpr uint64_t minor_diagonal_h1 = 0x0204'0810'2040'8001;
-      constexpr uint64_t minor_diagonal_a8 = 0x8001'0204'0810'2040;
-      return straight_path<minor_diagonal_h1, minor_diagonal_a8>();
+  }
+  return a;
+}();
+
+// Magics for the square-numbering of this file, one per square. Found offline by trial of random
+// sparse numbers, verified against `slide` when the tables are filled.
+constexpr std::array<uint64_t, 64> rook_magics{
+    0x0A80'0040'0080'1220, 0x10C0'1000'4000'2000, 0x0100'1020'0041'0009,
+    0x0B00'2100'0C10'0008, 0x4080'0800'8004'0002, 0x0200'0190'0408'0200,
+    0x0400'080A'1011'2684, 0x2080'0A4D'0006'2080, 0x2091'8000'2080'4000,
+    0x0044'4010'0020'0040, 0x1001'0020'0040'1108, 0x1001'8008'0110'0081,
+    0x0001'0005'0008'0010, 0x1000'8080'0200'0400, 0x0404'0004'8210'0108,
+    0x0003'0001'8261'0002, 0x0440'8480'02C0'0420, 0x2010'8900'4001'0021,
+    0x8800'1100'2004'4300, 0x0208'0101'0020'1000, 0x1222'0200'0410'2008,
+    0x0000'8080'0200'0400, 0x2004'0400'094A'9008, 0x0000'4200'0080'4401,
+    0x0040'0028'8000'4680, 0x0000'2002'4010'0040, 0x0020'0081'8020'1001,
+    0x0108'0080'800C'1000, 0x0104'0400'8080'0800, 0x4800'0200'8004'0080,
+    0x0002'0002'0084'0108, 0x00A1'0001'0000'6082, 0x8004'4000'8880'0260,
+    0x0100'8040'0080'2008, 0x0010'0080'1080'2002, 0x000C'8010'0080'0800,
+    0x0C51'8004'0280'0800, 0x0002'8002'0080'0400, 0x0000'8208'0400'0110,
+    0x4003'8080'4200'0401, 0x0020'8020'C001'8000, 0x4400'4020'1000'4009,
+    0x2210'0400'A800'E000, 0x0E02'0021'400A'0013, 0x10A0'0801'0011'0005,
+    0x0004'0100'0200'4040, 0x0024'0801'0204'0010, 0x4154'0891'0842'0014,
+    0x0182'4000'8000'2380, 0x0000'4001'1080'2100, 0x0000'1000'8020'0480,
+    0x100A'0008'2040'1200, 0x8081'0040'2080'1002, 0x0002'0004'0810'0200,
+    0x0322'3A10'0801'0C00, 0x0000'0083'1C01'4200, 0x4200'2080'0900'1041,
+    0xC001'0040'0088'1021, 0x1008'2001'0010'0841, 0x0000'0822'4092'0032,
+    0x4002'0008'0420'1102, 0xB821'0008'0400'0201, 0x4080'C208'1021'00A4,
+    0x0202'0900'418C'0CA2,
+};
+constexpr std::array<uint64_t, 64> bishop_magics{
+    0x002A'8404'0184'0308, 0x0002'0484'0400'4000, 0x1088'5081'0602'0000,
+    0x0604'0404'8400'0420, 0x1002'0210'0438'0001, 0x8041'0482'4000'0A30,
+    0x4084'0441'0410'3110, 0x0081'0040'4420'0840, 0x0442'4110'A101'0901,
+    0x0042'8208'4104'0080, 0x1001'0802'0400'2C09, 0x0001'4804'A104'1815,
+    0x0004'8202'1004'1001, 0x0001'8104'0340'0040, 0x0802'4041'0420'A084,
+    0x0410'1202'0101'0900, 0x0240'0485'0428'0200, 0x9402'0004'9004'0325,
+    0x2003'0010'1C09'8030, 0x0004'0028'4040'0800, 0x0002'0104'0211'0140,
+    0x0000'4032'0100'A060, 0x0042'0000'6104'6000, 0x0188'3000'8468'4808,
+    0x0010'1011'0802'1022, 0x8724'0480'2109'0C00, 0x502C'0202'C408'0010,
+    0x0008'0822'4802'0020, 0x0001'0200'8400'8400, 0x0891'0040'0208'2001,
+    0x000A'0210'0424'8200, 0x0011'0200'012A'8402, 0x2042'2084'3020'3904,
+    0x0C08'6208'1611'1880, 0x0002'0450'0441'0100, 0x0800'1201'8018'0080,
+    0x0140'0100'12C1'0040, 0x0050'1008'4040'2400, 0x0808'0200'8000'4801,
+    0x0004'8203'4102'0100, 0x001A'0124'2010'C080, 0x2018'6202'1001'2008,
+    0x8021'0400'220A'0400, 0x0020'0142'0082'0801, 0x0100'0881'0041'C400,
+    0x0020'0408'8020'5A01, 0x0010'8101'1102'E420, 0x0081'0604'810B'0208,
+    0x0000'6210'0421'0094, 0x0200'2108'0210'5811, 0x8008'0080'5808'0200,
+    0x5800'4000'8404'0010, 0x0000'0090'0202'2880, 0x9000'8830'0102'1010,
+    0x804A'8284'0404'0006, 0x2010'1218'0100'2800, 0x4012'0200'8401'0846,
+    0x8002'4212'0202'0200, 0x6104'0400'2084'1000, 0x0000'0002'0504'8804,
+    0x0808'0080'4110'2480, 0x2305'9040'0204'0440, 0x0810'4042'8202'0204,
+    0x0588'2001'0200'2100,
+};
+
+/**
+ * Attack sets of a sliding piece for every square and every relevant occupancy, addressed by
+ * "fancy" magic bitboards: ((occupancy & mask) * magic) >> shift is a perfect hash of the relevant
+ * occupancy into the per-square slice of the table. When the target supports BMI2, `pext` produces
+ * a dense index directly and the magics are unused.
+ */
+template <size_t size> class slider {
+  struct entry {
+    uint64_t mask, magic;
+    uint32_t offset;
+    unsigned shift;
+
+    [[nodiscard]] uint32_t index(const uint64_t occupancy) const noexcept {
+#ifdef __BMI2__
+      return offset + _pext_u64(occupancy, mask);
+#else
+      return offset + (((occupancy & mask) * magic) >> shift);
+#endif
     }
-    return std::nullopt;
   };
+
+  std::array<entry, 64> entries;
+  std::array<uint64_t, size> table;
+
+public:
+  slider(auto &&directions, const std::array<uint64_t, 64> &magics) noexcept {
+    uint32_t offset = 0;
+    for (const auto s : std::views::iota(0, 64)) {
+      auto &e = entries[s];
+      e.mask = relevant(s, directions);
+      e.magic = magics[s];
+      e.shift = 64 - std::popcount(e.mask);
+      e.offset = offset;
+      offset += uint32_t{1} << std::popcount(e.mask);
+      assert(offset <= size);
+      // Enumerate all subsets of the mask with the Carry-Rippler trick.
+      uint64_t subset = 0;
+      do {
+        const auto attacks = slide(s, subset, directions);
+        auto &slot = table[e.index(subset)];
+        // Magics may collide, but only constructively: same attacks for different occupancies.
+        assert(slot == 0 || slot == attacks);
+        slot = attacks;
+        subset = (subset - e.mask) & e.mask;
+      } while (subset != 0);
+    }
+    assert(offset == size);
+  }
+
+  [[nodiscard]] uint64_t operator()(const square s, const uint64_t occupancy) const noexcept {
+    return table[entries[s].index(occupancy)];
+  }
 };
 
-class configuration {
-  side white, black;
+// Filled at startup: 2^12 relevant occupancies at most for a rook, 2^9 for a bishop.
+inline const slider<0x19000> rook(rook_directions, rook_magics);
+inline const slider<0x1480> bishop(bishop_directions, bishop_magics);
+
+} // namespace impl
+
+[[nodiscard]] constexpr uint64_t knight(const square s) noexcept { return impl::knight[s]; }
+[[nodiscard]] constexpr uint64_t king(const square s) noexcept { return impl::king[s]; }
+/** Squares diagonally in front of a pawn, i.e. the squares it captures on. */
+[[nodiscard]] constexpr uint64_t pawn(const square s, const bool is_white) noexcept {
+  return (is_white ? impl::white_pawn : impl::black_pawn)[s];
+}
+
+/** Squares attacked by a rook on `s`, including the first blocker in every direction. */
+[[nodiscard]] constexpr uint64_t rook(const square s, const uint64_t occupancy) noexcept {
+  hot_path::count(hot_path::event::rook_attacks);
+  if consteval {
+    return impl::slide(s, occupancy, impl::rook_directions);
+  } else {
+    return impl::rook(s, occupancy);
+  }
+}
+/** Squares attacked by a bishop on `s`, including the first blocker in every direction. */
+[[nodiscard]] constexpr uint64_t bishop(const square s, const uint64_t occupancy) noexcept {
+  hot_path::count(hot_path::event::bishop_attacks);
+  if consteval {
+    return impl::slide(s, occupancy, impl::bishop_directions);
+  } else {
+    return impl::bishop(s, occupancy);
+  }
+}
+[[nodiscard]] constexpr uint64_t queen(const square s, const uint64_t occupancy) noexcept {
+  return rook(s, occupancy) | bishop(s, occupancy);
+}
+
+/** Squares strictly between two squares on a common rank, file or diagonal; otherwise empty. */
+[[nodiscard]] constexpr uint64_t between(const square a, const square b) noexcept {
+  return impl::alignments.between[a][b];
+}
+/** The whole rank, file or diagonal through two distinct squares; empty if they share none. */
+[[nodiscard]] constexpr uint64_t line(const square a, const square b) noexcept {
+  return impl::alignments.line[a][b];
+}
+
+static_assert(knight(0) == 0x0000'0000'0002'0400);       // h1 -> f2, g3
+static_assert(king(7) == 0x0000'0000'0000'C040);         // a1 -> b1, a2, b2
+static_assert(pawn(15, true) == 0x0000'0000'0040'0000);  // a2 -> b3
+static_assert(pawn(48, false) == 0x0000'0200'0000'0000); // h7 -> g6
+
+static_assert(rook(0, 0x0000'0000'0000'0100) == 0x0000'0000'0000'01FE); // h1, blocked on h2
+static_assert(bishop(7, 0) == 0x0102'0408'1020'4000);                   // a1 -> h8
+static_assert(between(7, 63) == 0x0080'8080'8080'8000);                  // a1 ... a8
+static_assert(line(0, 9) == 0x8040'2010'0804'0201);                      // h1, g2 ... a8
+
+} // namespace attacks
+
+/** https://prng.di.unimi.it/splitmix64.c */
+constexpr uint64_t splitmix64(uint64_t &state) noexcept {
+  auto z = state += 0x9E37'79B9'7F4A'7C15;
+  z = (z ^ (z >> 30)) * 0xBF58'476D'1CE4'E5B9;
+  z = (z ^ (z >> 27)) * 0x94D0'49BB'1331'11EB;
+  return z ^ (z >> 31);
+}
+
+// https://www.chessprogramming.org/Zobrist_Hashing
+namespace zobrist {
+namespace impl {
+
+struct table {
+  std::array<std::array<std::array<uint64_t, 64>, 7>, 2> pieces{}; // By color, then piece.
+  std::array<uint64_t, 16> castling{};                             // By set of rights.
+  std::array<uint64_t, 8> en_passant{};                            // By file.
+  uint64_t white_turn = 0;
+};
+
+constexpr auto keys = [] {
+  table k;
+  uint64_t state = 0x9D39'247E'3377'6D41;
+  for (auto &color : k.pieces) {
+    // `piece::empty` keeps zeroes so that toggling an empty square changes nothing.
+    for (auto &squares : color | std::views::drop(1)) {
+      for (auto &key : squares) {
+        key = splitmix64(state);
+      }
+    }
+  }
+  // One key per right, so that giving up a right is the same toggle whatever else is kept.
+  std::array<uint64_t, 4> rights;
+  for (auto &key : rights) {
+    key = splitmix64(state);
+  }
+  for (size_t set = 0; set < k.castling.size(); ++set) {
+    for (size_t right = 0; right < rights.size(); ++right) {
+      if (set >> right & 1) {
+        k.castling[set] ^= rights[right];
+      }
+    }
+  }
+  for (auto &key : k.en_passant) {
+    key = splitmix64(state);
+  }
+  k.white_turn = splitmix64(state);
+  return k;
+}();
+
+} // namespace impl
+
+[[nodiscard]] constexpr uint64_t piece_square(const bool is_white, const piece p,
+                                              const square s) noexcept {
+  return impl::keys.pieces[is_white][std::to_underlying(p)][s];
+}
+[[nodiscard]] constexpr uint64_t castling(const uint8_t rights) noexcept {
+  return impl::keys.castling[rights];
+}
+/** Keyed by file only, and nothing at all when there is no en passant square. */
+[[nodiscard]] constexpr uint64_t en_passant(const uint64_t mask) noexcept {
+  return mask ? impl::keys.en_passant[std::countr_zero(mask) % 8] : 0;
+}
+[[nodiscard]] constexpr uint64_t white_turn() noexcept { return impl::keys.white_turn; }
+
+static_assert(piece_square(true, piece::empty, 0) == 0);
+static_assert(castling(0b0000) == 0);
+static_assert(castling(0b0101) == (castling(0b0001) ^ castling(0b0100)));
+static_assert(en_passant(0) == 0);
+
+} // namespace zobrist
+
+/** A position, generic over the layout of each side: `side`, or `wide_side`. */
+template <class Side> class basic_configuration {
+public:
+  static constexpr uint8_t white_kingside = 0b0001, white_queenside = 0b0010;
+  static constexpr uint8_t black_kingside = 0b0100, black_queenside = 0b1000;
 
-  constexpr configuration(const side white, const side black) : white(white), black(black) {
+private:
+  Side white, black;
+  bool white_turn;
+  uint8_t castling;
+  uint64_t en_passant; // The square a pawn skipped over with its double step, if any.
+  uint64_t key;        // Zobrist key, kept up to date by every move.
+
+  // Castling rights that survive a move from or to a square: moving the king or a rook, or
+  // capturing a rook, gives them up.
+  static constexpr auto castling_kept = [] {
+    std::array<uint8_t, 64> kept{};
+    std::ranges::fill(kept, 0b1111);
+    kept[3] = 0b1111 ^ white_kingside ^ white_queenside;  // e1
+    kept[0] = 0b1111 ^ white_kingside;                    // h1
+    kept[7] = 0b1111 ^ white_queenside;                   // a1
+    kept[59] = 0b1111 ^ black_kingside ^ black_queenside; // e8
+    kept[56] = 0b1111 ^ black_kingside;                   // h8
+    kept[63] = 0b1111 ^ black_queenside;                  // a8
+    return kept;
+  }();
+
+  [[nodiscard]] constexpr uint64_t occupancy() const noexcept {
+    return black.get_occupancy() ^ white.get_occupancy();
+  }
+
+  [[nodiscard]] constexpr bool empty(const uint64_t mask) const noexcept {
+    return !(mask & occupancy());
+  }
+
+  // Everything that differs between the colors, fixed at compile time so that each color gets
+  // its own code with constant directions and masks instead of branching on `white_turn`.
+  template <bool is_white>
+  static constexpr uint64_t pawn_rank = is_white ? 0x0000'0000'0000'FF00 : 0x00FF'0000'0000'0000;
+  template <bool is_white>
+  static constexpr uint64_t last_rank = is_white ? 0xFF00'0000'0000'0000 : 0x0000'0000'0000'00FF;
+  template <bool is_white> static constexpr int first_rank = is_white ? 0 : 56;
+  template <bool is_white>
+  static constexpr uint8_t kingside = is_white ? white_kingside : black_kingside;
+  template <bool is_white>
+  static constexpr uint8_t queenside = is_white ? white_queenside : black_queenside;
+
+  /** Moves every square of `mask` one rank towards the opponent of the given color. */
+  template <bool is_white>
+  [[nodiscard]] static constexpr uint64_t forward(const uint64_t mask) noexcept {
+    if constexpr (is_white) {
+      return mask << 8;
+    } else {
+      return mask >> 8;
+    }
+  }
+
+  template <bool is_white> [[nodiscard]] constexpr Side &side_of() noexcept {
+    if constexpr (is_white) {
+      return white;
+    } else {
+      return black;
+    }
+  }
+
+  template <bool is_white> [[nodiscard]] constexpr const Side &side_of() const noexcept {
+    if constexpr (is_white) {
+      return white;
+    } else {
+      return black;
+    }
+  }
+
+  /** Whether the king of the given color is attacked: one mask test per kind of attacker. */
+  template <bool is_white> [[nodiscard]] constexpr bool check() const noexcept {
+    hot_path::count(hot_path::event::check);
+    const auto &us = side_of<is_white>();
+    const auto &them = side_of<!is_white>();
+    const auto king = us.get_king_square();
+    const auto occupied = occupancy();
+    const auto queens = them.get_bitboard(piece::queen);
+    // A pawn attacks the king from where a pawn on the king's square would capture.
+    return (attacks::pawn(king, is_white) & them.get_bitboard(piece::pawn)) ||
+           (attacks::knight(king) & them.get_bitboard(piece::knight)) ||
+           (attacks::king(king) & them.get_bitboard(piece::king)) ||
+           (attacks::rook(king, occupied) & (them.get_bitboard(piece::rook) | queens)) ||
+           (attacks::bishop(king, occupied) & (them.get_bitboard(piece::bishop) | queens));
+  }
+
+public:
+  constexpr basic_configuration(const Side white, const Side black, const bool white_turn = true,
+                                const uint8_t castling = 0b1111, const uint64_t en_passant = 0)
+      : white(white), black(black), white_turn(white_turn), castling(castling),
+        en_passant(en_passant), key(compute_key()) {
     // Pieces of different colors DO NOT share any square.
     assert((black.get_occupancy() & white.get_occupancy()) == 0);
 
-    constexpr auto is_king = [](const side::iterator::value_type v) {
+    constexpr auto is_king = [](const typename Side::iterator::value_type v) {
       return v.piece == piece::king;
     };
     // There is exactly 1 king for each side.
@@ -184,141 +818,440 @@ class configuration {
     assert(std::ranges::count_if(black, is_king) == 1);
   }
 
-  [[nodiscard]] constexpr bool empty(const uint64_t mask) const noexcept {
-    return !(mask & (black.get_occupancy() ^ white.get_occupancy()));
+  constexpr basic_configuration()
+      : basic_configuration(Side::initial_white(), Side::initial_black()) {}
+
+  [[nodiscard]] constexpr const auto &get_white() const noexcept { return white; }
+  [[nodiscard]] constexpr const auto &get_black() const noexcept { return black; }
+  [[nodiscard]] constexpr bool is_white_turn() const noexcept { return white_turn; }
+  [[nodiscard]] constexpr uint8_t get_castling() const noexcept { return castling; }
+  [[nodiscard]] constexpr uint64_t get_en_passant() const noexcept { return en_passant; }
+  [[nodiscard]] constexpr uint64_t get_key() const noexcept { return key; }
+
+  /**
+   * The Zobrist key computed from scratch by walking both sides; `get_key` MUST always agree,
+   * which is asserted after every move in debug builds.
+   */
+  [[nodiscard]] constexpr uint64_t compute_key() const noexcept {
+    uint64_t k = zobrist::castling(castling) ^ zobrist::en_passant(en_passant);
+    if (white_turn) {
+      k ^= zobrist::white_turn();
+    }
+    for (const auto [piece, shift] : white) {
+      k ^= zobrist::piece_square(true, piece, shift);
+    }
+    for (const auto [piece, shift] : black) {
+      k ^= zobrist::piece_square(false, piece, shift);
+    }
+    return k;
   }
 
-  [[nodiscard]] constexpr bool check(const bool is_white) const noexcept {
-    const auto dst_square = (is_white ? white : black).get_king_square();
-    const auto opponent = is_white ? black : white;
-    for (const auto [piece, shift] : opponent) {
-      if (test_move(piece, move(shift, dst_square))) {
-        return true;
+  [[nodiscard]] constexpr bool in_check() const noexcept {
+    return white_turn ? check<true>() : check<false>();
+  }
+
+  /**
+   * Every legal move of the side to move. Checkers and pins are found in one pass over the
+   * opponent, after which each move is legal by construction; nothing is tried and taken back.
+   */
+  template <move_kind kind = move_kind::all>
+  [[nodiscard]] constexpr move_list generate_legal_moves() const noexcept {
+    return white_turn ? generate<kind, true>() : generate<kind, false>();
+  }
+
+  /**
+   * Whether `m`, which may come from anywhere such as a transposition table, is a legal move of
+   * the side to move. Cheaper than looking for it among the generated moves, except for castling.
+   */
+  [[nodiscard]] constexpr bool is_legal(const move m) const noexcept {
+    return white_turn ? is_legal<true>(m) : is_legal<false>(m);
+  }
+
+private:
+  template <bool is_white> [[nodiscard]] constexpr bool is_legal(const move m) const noexcept {
+    const auto p = side_of<is_white>().get(m.get_src_square());
+    if (p == piece::empty || m.dst(side_of<is_white>()) ||
+        (p != piece::pawn && m.get_promotion() != piece::empty)) {
+      return false;
+    }
+    if (p == piece::king && (m.dst() == m.src() << 2 || m.src() == m.dst() << 2)) {
+      const auto moves = generate<move_kind::quiet, is_white>();
+      return std::ranges::find(moves, m) != moves.end();
+    }
+    if (!test_move(p, m)) {
+      return false;
+    }
+    auto next = *this;
+    next.template make<is_white>(m);
+    return !next.template check<is_white>();
+  }
+
+  template <move_kind kind, bool is_white>
+  [[nodiscard]] constexpr move_list generate() const noexcept {
+    move_list moves;
+    const auto &us = side_of<is_white>();
+    const auto &them = side_of<!is_white>();
+    const auto own = us.get_occupancy(), opponent = them.get_occupancy();
+    const auto occupied = own ^ opponent;
+    const auto king = us.get_king_square();
+    const auto king_bit = uint64_t{1} << king;
+
+    // Squares attacked by the opponent, seen through our king so that it cannot retreat along a
+    // checking ray, and the pieces giving check.
+    uint64_t danger = 0, checkers = 0, orthogonal = 0, diagonal = 0;
+    for (const auto [piece, shift] : them) {
+      uint64_t attacked = 0;
+      switch (piece) {
+      case piece::pawn:
+        attacked = attacks::pawn(shift, !is_white);
+        break;
+      case piece::knight:
+        attacked = attacks::knight(shift);
+        break;
+      case piece::king:
+        attacked = attacks::king(shift);
+        break;
+      case piece::rook:
+        orthogonal |= uint64_t{1} << shift;
+        attacked = attacks::rook(shift, occupied ^ king_bit);
+        break;
+      case piece::bishop:
+        diagonal |= uint64_t{1} << shift;
+        attacked = attacks::bishop(shift, occupied ^ king_bit);
+        break;
+      case piece::queen:
+        orthogonal |= uint64_t{1} << shift;
+        diagonal |= uint64_t{1} << shift;
+        attacked = attacks::queen(shift, occupied ^ king_bit);
+        break;
+      case piece::empty:
+        std::unreachable();
+      }
+      danger |= attacked;
+      if (attacked & king_bit) {
+        checkers |= uint64_t{1} << shift;
+      }
+    }
+
+    const auto add = [&moves](const square src, uint64_t targets) {
+      for (; targets; targets &= targets - 1) {
+        moves.push_back(move(src, std::countr_zero(targets)));
+      }
+    };
+
+    // Where pieces other than pawns may go to make a move of the requested kind.
+    auto targets = ~uint64_t{0};
+    if constexpr (kind == move_kind::noisy) {
+      targets = opponent;
+    } else if constexpr (kind == move_kind::quiet) {
+      targets = ~opponent;
+    }
+
+    add(king, attacks::king(king) & ~own & ~danger & targets);
+    if (checkers & (checkers - 1)) {
+      return moves; // Double check: only the king can move.
+    }
+
+    // Our pieces that are the only blocker between an opponent slider and our king.
+    uint64_t pinned = 0;
+    for (auto snipers = (attacks::rook(king, opponent) & orthogonal) |
+                        (attacks::bishop(king, opponent) & diagonal);
+         snipers; snipers &= snipers - 1) {
+      const auto blockers = attacks::between(king, std::countr_zero(snipers)) & occupied;
+      if (std::has_single_bit(blockers)) {
+        pinned |= blockers & own;
+      }
+    }
+
+    // Out of check, a move must capture the checker or block its ray.
+    const auto evasion = checkers ? checkers | attacks::between(king, std::countr_zero(checkers))
+                                  : ~uint64_t{0};
+
+    if (kind != move_kind::noisy && !checkers) {
+      // The king passes f1 and g1, or d1 and c1; the rook also passes b1.
+      constexpr auto kingside_path = uint64_t{0b0110} << first_rank<is_white>;
+      constexpr auto queenside_path = uint64_t{0b0111'0000} << first_rank<is_white>;
+      constexpr auto queenside_walk = uint64_t{0b0011'0000} << first_rank<is_white>;
+      if ((castling & kingside<is_white>) && !(occupied & kingside_path) &&
+          !(danger & kingside_path)) {
+        moves.push_back(move(king, king - 2));
+      }
+      if ((castling & queenside<is_white>) && !(occupied & queenside_path) &&
+          !(danger & queenside_walk)) {
+        moves.push_back(move(king, king + 2));
+      }
+    }
+
+    for (const auto [piece, shift] : us) {
+      const auto bit = uint64_t{1} << shift;
+      const auto pin = pinned & bit ? attacks::line(king, shift) : ~uint64_t{0};
+      const auto allowed = ~own & evasion & pin;
+      switch (piece) {
+      case piece::pawn: {
+        const auto single = forward<is_white>(bit) & ~occupied;
+        const auto twice = bit & pawn_rank<is_white> ? forward<is_white>(single) & ~occupied : 0;
+        const auto captures = attacks::pawn(shift, is_white) & opponent;
+        auto pawn_targets = single | twice | captures;
+        if constexpr (kind == move_kind::noisy) {
+          pawn_targets = captures | (single & last_rank<is_white>); // Every promotion is noisy.
+        } else if constexpr (kind == move_kind::quiet) {
+          pawn_targets = (single | twice) & ~last_rank<is_white>;
+        }
+        for (auto destinations = pawn_targets & allowed; destinations;
+             destinations &= destinations - 1) {
+          const square dst = std::countr_zero(destinations);
+          if (destinations & -destinations & last_rank<is_white>) {
+            for (const auto promotion : {piece::queen, piece::rook, piece::bishop, piece::knight}) {
+              moves.push_back(move(shift, dst, promotion));
+            }
+          } else {
+            moves.push_back(move(shift, dst));
+          }
+        }
+        if (kind != move_kind::quiet && en_passant & attacks::pawn(shift, is_white)) {
+          // Both pawns leave their rank at once, which a pin mask cannot capture; look again.
+          const auto captured = forward<!is_white>(en_passant);
+          const auto after = occupied ^ bit ^ captured ^ en_passant;
+          if ((evasion & (en_passant | captured)) && !(attacks::rook(king, after) & orthogonal) &&
+              !(attacks::bishop(king, after) & diagonal)) {
+            moves.push_back(move(shift, std::countr_zero(en_passant)));
+          }
+        }
+        break;
+      }
+      case piece::knight:
+        add(shift, attacks::knight(shift) & allowed & targets);
+        break;
+      case piece::bishop:
+        add(shift, attacks::bishop(shift, occupied) & allowed & targets);
+        break;
+      case piece::rook:
+        add(shift, attacks::rook(shift, occupied) & allowed & targets);
+        break;
+      case piece::queen:
+        add(shift, attacks::queen(shift, occupied) & allowed & targets);
+        break;
+      case piece::king:
+      case piece::empty:
+        break;
       }
     }
-    return false;
+    return moves;
+  }
+
+  /** Makes `m` in place and returns what it takes to undo it. */
+  constexpr ply make(const move m) noexcept {
+    return white_turn ? make<true>(m) : make<false>(m);
+  }
+
+  template <bool is_white> constexpr ply make(const move m) noexcept {
+    auto &us = side_of<is_white>();
+    auto &them = side_of<!is_white>();
+    const auto src = m.get_src_square(), dst = m.get_dst_square();
+    ply undo{m, piece::empty, castling, en_passant, key};
+    const auto p = us.erase(src);
+    key ^= zobrist::piece_square(is_white, p, src);
+    if (m.dst(them)) {
+      undo.captured = them.erase(dst);
+      key ^= zobrist::piece_square(!is_white, undo.captured, dst);
+    } else if (p == piece::pawn && m.dst(en_passant)) {
+      const square captured = is_white ? dst - 8 : dst + 8;
+      undo.captured = them.erase(captured);
+      key ^= zobrist::piece_square(!is_white, undo.captured, captured);
+    }
+    const auto placed = m.get_promotion() == piece::empty ? p : m.get_promotion();
+    us.insert(placed, dst);
+    key ^= zobrist::piece_square(is_white, placed, dst);
+    if (p == piece::king && (m.dst() == m.src() << 2 || m.src() == m.dst() << 2)) {
+      // Castling: the rook jumps over to the other side of the king.
+      const bool kingside = dst < src;
+      const square from = kingside ? src - 3 : src + 4, to = kingside ? src - 1 : src + 1;
+      us.insert(us.erase(from), to);
+      key ^= zobrist::piece_square(is_white, piece::rook, from) ^
+             zobrist::piece_square(is_white, piece::rook, to);
+    }
+    key ^= zobrist::castling(castling) ^ zobrist::en_passant(en_passant);
+    castling &= castling_kept[src] & castling_kept[dst];
+    const bool double_step = m.dst() == m.src() << 16 || m.src() == m.dst() << 16;
+    en_passant = p == piece::pawn && double_step ? forward<is_white>(m.src()) : 0;
+    key ^= zobrist::castling(castling) ^ zobrist::en_passant(en_passant) ^ zobrist::white_turn();
+    white_turn = !white_turn;
+    assert(key == compute_key());
+    return undo;
   }
 
 public:
-  constexpr configuration() : configuration(side::initial_white(), side::initial_black()) {}
+  /**
+   * Makes `m`, which MUST be a legal move of the side to move, in place. Only the squares `m`
+   * touches are updated, and what `unmake_move` needs is pushed onto `plies`.
+   */
+  constexpr void make_move(const move m, ply_stack &plies) noexcept { plies.push(make(m)); }
 
-  [[nodiscard]] constexpr const auto &get_white() const noexcept { return white; }
-  [[nodiscard]] constexpr const auto &get_black() const noexcept { return black; }
+  /** Takes back the latest move made with `make_move`. */
+  constexpr void unmake_move(ply_stack &plies) noexcept {
+    const auto undo = plies.pop();
+    white_turn = !white_turn;
+    castling = undo.castling;
+    en_passant = undo.en_passant;
+    key = undo.key;
+    white_turn ? unmake<true>(undo) : unmake<false>(undo);
+    assert(key == compute_key());
+  }
 
   /**
-   * 1. Must not leave your king attacked after the move.
-   * 2. Stalemate?
+   * Passes the turn, which MUST NOT be done in check; the pushed ply holds the null move h1h1.
+   * Searches use it to see whether a position is good even without moving.
    */
-  [[nodiscard]] constexpr std::optional<configuration> try_move(const piece p, const move m) const {
-    // TODO: escape if in check; otherwise, checkmate.
+  constexpr void make_null_move(ply_stack &plies) noexcept {
+    assert(!in_check());
+    plies.push(ply{move(0, 0), piece::empty, castling, en_passant, key});
+    key ^= zobrist::en_passant(en_passant) ^ zobrist::white_turn();
+    en_passant = 0;
+    white_turn = !white_turn;
+  }
 
-    // src must not be empty.
-    if (!m.src(black) && !m.src(white)) {
-      return std::nullopt;
-    }
+  /** Takes back the latest move made with `make_null_move`. */
+  constexpr void unmake_null_move(ply_stack &plies) noexcept {
+    const auto undo = plies.pop();
+    assert(undo.move == move(0, 0));
+    white_turn = !white_turn;
+    en_passant = undo.en_passant;
+    key = undo.key;
+  }
 
-    // src and dst are NOT of the same color; dst could be empty.
-    if (m.src(black) && m.dst(black)) {
-      return std::nullopt;
+private:
+  template <bool is_white> constexpr void unmake(const ply &undo) noexcept {
+    const auto m = undo.move;
+    const auto captured = undo.captured;
+    auto &us = side_of<is_white>();
+    auto &them = side_of<!is_white>();
+    const auto src = m.get_src_square(), dst = m.get_dst_square();
+    auto p = us.erase(dst);
+    if (m.get_promotion() != piece::empty) {
+      p = piece::pawn;
     }
-    if (m.src(white) && m.dst(white)) {
-      return std::nullopt;
+    us.insert(p, src);
+    if (p == piece::king && (m.dst() == m.src() << 2 || m.src() == m.dst() << 2)) {
+      const bool kingside = dst < src;
+      us.insert(us.erase(kingside ? src - 1 : src + 1), kingside ? src - 3 : src + 4);
+    }
+    if (captured != piece::empty) {
+      // The en passant square is always empty, so only a pawn capturing en passant lands there.
+      const bool en_passant_capture = p == piece::pawn && m.dst(en_passant);
+      them.insert(captured, en_passant_capture ? (is_white ? dst - 8 : dst + 8) : dst);
     }
+  }
 
-    // assert(src != dst); // implied by the previous conditions
+public:
+  /** The configuration after `m`, which MUST be a legal move of the side to move. */
+  [[nodiscard]] constexpr basic_configuration play(const move m) const noexcept {
+    auto next = *this;
+    next.make(m);
+    return next;
+  }
 
-    if (!test_move(p, m)) {
+  /** The configuration after `m`, provided that `p` may legally make it. */
+  [[nodiscard]] constexpr std::optional<basic_configuration> try_move(const piece p,
+                                                                      const move m) const {
+    return white_turn ? try_move<true>(p, m) : try_move<false>(p, m);
+  }
+
+private:
+  template <bool is_white>
+  [[nodiscard]] constexpr std::optional<basic_configuration> try_move(const piece p,
+                                                                      const move m) const {
+    hot_path::count(hot_path::event::try_move);
+    if (side_of<is_white>().get(m.get_src_square()) != p) {
+      hot_path::count(hot_path::event::try_move_wrong_piece);
       return std::nullopt;
     }
-    if (check(m.src(white))) {
+    const auto moves = generate<move_kind::all, is_white>();
+    if (std::ranges::find(moves, m) == moves.end()) {
+      hot_path::count(hot_path::event::try_move_illegal);
       return std::nullopt;
     }
+    auto next = *this;
+    next.template make<is_white>(m);
+    return next;
+  }
 
-    const auto both_ends = m.src(m.dst());
-    return configuration{white, black}; // FIXME: update white and black
+  /** Whether the pawn of the given color standing on the source square of `m` may make it. */
+  template <bool is_white> [[nodiscard]] constexpr bool test_pawn_move(const move m) const {
+    // There are NO pawns at the last rank. It must have been promoted.
+    assert(!m.src(last_rank<is_white>));
+    // Reaching the last rank promotes the pawn, and nothing else does.
+    bool promotes = false;
+    switch (m.get_promotion()) {
+    case piece::empty:
+      break;
+    case piece::queen:
+    case piece::rook:
+    case piece::bishop:
+    case piece::knight:
+      promotes = true;
+      break;
+    case piece::pawn:
+    case piece::king:
+      hot_path::count(hot_path::event::test_move_promotion);
+      return false;
+    }
+    if (promotes != static_cast<bool>(m.dst(last_rank<is_white>))) {
+      hot_path::count(hot_path::event::test_move_promotion);
+      return false;
+    }
+    const auto reject = [](const hot_path::event reason) {
+      hot_path::count(reason);
+      return false;
+    };
+    if (m.dst(attacks::pawn(m.get_src_square(), is_white))) {
+      // Capturing an opponent's piece, or the pawn that has just skipped over dst.
+      return m.dst(side_of<!is_white>()) || m.dst(en_passant) ||
+             reject(hot_path::event::test_move_no_capture);
+    }
+    if (m.dst() == forward<is_white>(m.src())) { // Advancing 1 square.
+      return empty(m.dst()) || reject(hot_path::event::test_move_blocked);
+    }
+    if (m.dst() == forward<is_white>(forward<is_white>(m.src())) && m.src(pawn_rank<is_white>)) {
+      // Advancing 2 squares.
+      return empty(m.dst() | forward<is_white>(m.src())) ||
+             reject(hot_path::event::test_move_blocked);
+    }
+    return reject(hot_path::event::test_move_unreachable);
   }
 
+public:
   [[nodiscard]] constexpr bool test_move(const piece p, const move m) const {
+    hot_path::count(hot_path::event::test_move);
+    uint64_t reach = 0;
     switch (p) {
     case piece::pawn:
-      // TODO: advancing 1 square
-      // TODO: advancing 2 squares on first move
-      // TODO: regular capturing
-      // TODO: capturing en passant
-      // TODO: promotion at last rank
-      if (m.src(black)) {
-        // TODO: move black pawn.
-      } else { // Move white pawn.
-        constexpr uint64_t last_rank = 0xFF00'0000'0000'0000;
-        // There are NO pawns at the last rank. It must have been promoted.
-        assert(!m.src(last_rank));
-        const auto [rank_diff, file_diff] = m.diff();
-        switch (rank_diff) {
-        case 1: // Advancing 1 square.
-          switch (file_diff) {
-          case 0: // Moving on the same file without capture.
-            assert(empty(m.dst()));
-            if (m.dst(last_rank)) {
-              // TODO: require promotion of the same color as an immediate next step.
-            }
-            break;
-          case -1:
-          case 1:
-            if (empty(m.dst())) {
-              // TODO: capture en passant.
-            } else { // Capture regularly.
-              // Guaranteed to be capturing opponent's piece.
-            }
-            break;
-          default:
-            assert(false);
-          }
-          break;
-        case 2:                                 // Advancing 2 squares.
-          assert(file_diff == 0);               // MUST move on the same file.
-          assert(m.src(0x0000'0000'0000'FF00)); // MUST be first move.
-          assert(empty(m.dst()));
-          // TODO: signal potential capturing en passant for the immediate next step.
-          break;
-        default:
-          assert(false);
-        }
-      }
-      return true;
-    case piece::king: {
-      const auto [rank_diff, file_diff] = m.diff();
-      return std::max(::abs(rank_diff), std::abs(file_diff)) == 1; // max-norm
-    }
-    case piece::knight: {
-      const auto [rank_diff, file_diff] = m.diff();
-      return std::abs(rank_diff * file_diff) == 2;
-    }
+      // The owner of the pawn is the only thing decided at run time.
+      return m.src(black) ? test_pawn_move<false>(m) : test_pawn_move<true>(m);
+    case piece::king:
+      reach = attacks::king(m.get_src_square());
+      break;
+    case piece::knight:
+      reach = attacks::knight(m.get_src_square());
+      break;
     case piece::rook:
-      if (const auto path = m.cardinal_path()) {
-        return empty(m.src(*path)); // All squares between src and dst are empty.
-      }
-      return false;
+      reach = attacks::rook(m.get_src_square(), occupancy());
+      break;
     case piece::bishop:
-      if (const auto path = m.ordinal_path()) {
-        return empty(m.src(*path)); // All squares between src and dst are empty.
-      }
-      return false;
+      reach = attacks::bishop(m.get_src_square(), occupancy());
+      break;
     case piece::queen:
-      if (const auto path = m.cardinal_path()) {
-        return empty(m.src(*path)); // All squares between src and dst are empty.
-      }
-      if (const auto path = m.ordinal_path()) {
-        return empty(m.src(*path)); // All squares between src and dst are empty.
-      }
-      return false;
+      reach = attacks::queen(m.get_src_square(), occupancy());
+      break;
     case piece::empty:
+      hot_path::count(hot_path::event::test_move_no_piece);
+      return false;
+    }
+    if (!m.dst(reach)) {
+      hot_path::count(hot_path::event::test_move_unreachable);
       return false;
     }
-    std::unreachable();
+    return true;
   }
 };
 
-struct ply {
-  configuration config;
-  bool white_turn;
-};
+using configuration = basic_configuration<side>;
@@ -0,0 +1,105 @@
+// https://www.chessprogramming.org/Simplified_Evaluation_Function
+#pragma once
+#include "chess.hpp"
+
+namespace evaluation {
+
+namespace impl {
+
+using table = std::array<int, 64>;
+
+// Seen from white, as the board is printed: a8 first, h1 last. Square s of white is `63 ^ s`.
+constexpr std::array<table, 7> placement{
+    table{},
+    table{
+        0,  0,  0,   0,   0,   0,   0,  0,  //
+        50, 50, 50,  50,  50,  50,  50, 50, //
+        10, 10, 20,  30,  30,  20,  10, 10, //
+        5,  5,  10,  25,  25,  10,  5,  5,  //
+        0,  0,  0,   20,  20,  0,   0,  0,  //
+        5,  -5, -10, 0,   0,   -10, -5, 5,  //
+        5,  10, 10,  -20, -20, 10,  10, 5,  //
+        0,  0,  0,   0,   0,   0,   0,  0,  //
+    },
+    table{
+        0,  0,  0,  0,  0,  0,  0,  0,  //
+        5,  10, 10, 10, 10, 10, 10, 5,  //
+        -5, 0,  0,  0,  0,  0,  0,  -5, //
+        -5, 0,  0,  0,  0,  0,  0,  -5, //
+        -5, 0,  0,  0,  0,  0,  0,  -5, //
+        -5, 0,  0,  0,  0,  0,  0,  -5, //
+        -5, 0,  0,  0,  0,  0,  0,  -5, //
+        0,  0,  0,  5,  5,  0,  0,  0,  //
+    },
+    table{
+        -50, -40, -30, -30, -30, -30, -40, -50, //
+        -40, -20, 0,   0,   0,   0,   -20, -40, //
+        -30, 0,   10,  15,  15,  10,  0,   -30, //
+        -30, 5,   15,  20,  20,  15,  5,   -30, //
+        -30, 0,   15,  20,  20,  15,  0,   -30, //
+        -30, 5,   10,  15,  15,  10,  5,   -30, //
+        -40, -20, 0,   5,   5,   0,   -20, -40, //
+        -50, -40, -30, -30, -30, -30, -40, -50, //
+    },
+    table{
+        -20, -10, -10, -10, -10, -10, -10, -20, //
+        -10, 0,   0,   0,   0,   0,   0,   -10, //
+        -10, 0,   5,   10,  10,  5,   0,   -10, //
+        -10, 5,   5,   10,  10,  5,   5,   -10, //
+        -10, 0,   10,  10,  10,  10,  0,   -10, //
+        -10, 10,  10,  10,  10,  10,  10,  -10, //
+        -10, 5,   0,   0,   0,   0,   5,   -10, //
+        -20, -10, -10, -10, -10, -10, -10, -20, //
+    },
+    table{
+        -20, -10, -10, -5, -5, -10, -10, -20, //
+        -10, 0,   0,   0,  0,  0,   0,   -10, //
+        -10, 0,   5,   5,  5,  5,   0,   -10, //
+        -5,  0,   5,   5,  5,  5,   0,   -5,  //
+        0,   0,   5,   5,  5,  5,   0,   -5,  //
+        -10, 5,   5,   5,  5,  5,   0,   -10, //
+        -10, 0,   5,   0,  0,  0,   0,   -10, //
+        -20, -10, -10, -5, -5, -10, -10, -20, //
+    },
+    table{
+        -30, -40, -40, -50, -50, -40, -40, -30, //
+        -30, -40, -40, -50, -50, -40, -40, -30, //
+        -30, -40, -40, -50, -50, -40, -40, -30, //
+        -30, -40, -40, -50, -50, -40, -40, -30, //
+        -20, -30, -30, -40, -40, -30, -30, -20, //
+        -10, -20, -20, -20, -20, -20, -20, -10, //
+        20,  20,  0,   0,   0,   0,   20,  20,  //
+        20,  30,  10,  0,   0,   10,  30,  20,  //
+    },
+};
+
+} // namespace impl
+
+/** Centipawns, indexed by `piece`; the king is never traded, so it is worth nothing here. */
+constexpr std::array<int, 7> value{0, 100, 500, 320, 330, 900, 0};
+
+/** Material and placement of one piece, seen from its own side. */
+[[nodiscard]] constexpr int piece_square(const bool is_white, const piece p,
+                                         const square s) noexcept {
+  const auto index = is_white ? 63 ^ s : 7 ^ s; // Black sees the board upside down.
+  return value[std::to_underlying(p)] + impl::placement[std::to_underlying(p)][index];
+}
+
+/** Centipawns in favour of the side to move. */
+template <class Side>
+[[nodiscard]] constexpr int evaluate(const basic_configuration<Side> &config) noexcept {
+  int score = 0;
+  for (const auto [piece, shift] : config.get_white()) {
+    score += piece_square(true, piece, shift);
+  }
+  for (const auto [piece, shift] : config.get_black()) {
+    score -= piece_square(false, piece, shift);
+  }
+  return config.is_white_turn() ? score : -score;
+}
+
+static_assert(piece_square(true, piece::pawn, 11) == 80);  // e2
+static_assert(piece_square(false, piece::pawn, 51) == 80); // e7
+static_assert(evaluate(configuration()) == 0);
+
+} // namespace evaluation
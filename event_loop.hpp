@@ -0,0 +1,182 @@
+// https://cr.yp.to/docs/selfpipe.html
+// https://invisible-island.net/xterm/ctlseqs/ctlseqs.html#h2-PC-Style-Function-Keys
+#pragma once
+#include <algorithm>
+#include <array>
+#include <cassert>
+#include <cerrno>
+#include <chrono>
+#include <csignal>
+#include <cstdint>
+#include <fcntl.h>
+#include <initializer_list>
+#include <optional>
+#include <poll.h>
+#include <span>
+#include <unistd.h>
+
+/** A key as a terminal sends it: a character of its own, or one of a few escape sequences. */
+struct key {
+  enum kind : uint8_t { character, escape, up, down, right, left, other } kind;
+  char ch = '\0'; // Of a `character`.
+
+  constexpr bool operator==(const key &) const noexcept = default;
+};
+
+/**
+ * Turns the bytes of a terminal into keys, however the reads split them. A lone escape is
+ * ambiguous until the next byte, or its absence for a while, tells it from the start of a
+ * sequence: while `pending`, the caller waits that long for more and then calls `flush`.
+ */
+class key_decoder {
+  enum class state : uint8_t { ground, escape, sequence } at = state::ground;
+
+public:
+  /** How long an escape waits for the rest of a sequence; terminals send one in a single write. */
+  static constexpr std::chrono::milliseconds escape_timeout{25};
+
+  [[nodiscard]] bool pending() const noexcept { return at != state::ground; }
+
+  /** Calls `emit` with each key that `bytes` complete. */
+  void feed(const std::span<const char> bytes, auto &&emit) {
+    for (const char c : bytes) {
+      switch (at) {
+      case state::ground:
+        if (c == '\033') {
+          at = state::escape;
+        } else {
+          emit(key{key::character, c});
+        }
+        break;
+      case state::escape:
+        // CSI or SS3, as cursor keys come in normal and application mode; anything else was a
+        // lone escape followed by a key of its own.
+        if (c == '[' || c == 'O') {
+          at = state::sequence;
+        } else {
+          emit(key{key::escape});
+          at = state::ground;
+          feed(std::span(&c, 1), emit);
+        }
+        break;
+      case state::sequence:
+        // Parameters and intermediates until the final byte, from '@' to '~'.
+        if ('@' <= c && c <= '~') {
+          constexpr std::array arrows{key::up, key::down, key::right, key::left};
+          emit(key{'A' <= c && c <= 'D' ? arrows[c - 'A'] : key::other});
+          at = state::ground;
+        }
+        break;
+      }
+    }
+  }
+
+  /** Ends what is pending: a lone escape is one after all, and a broken sequence is dropped. */
+  void flush(auto &&emit) {
+    if (at == state::escape) {
+      emit(key{key::escape});
+    }
+    at = state::ground;
+  }
+};
+
+/**
+ * Waits on one input file descriptor and on a self-pipe, which signal handlers and other
+ * threads write to, with a single poll(2): nothing runs while nothing happens, and no signal
+ * interrupts anything but the wait. A process has at most one loop catching signals.
+ */
+class event_loop {
+  static inline int signal_pipe = -1; // The write end, for the handler.
+
+  std::array<int, 2> pipe_fds; // Read end, write end.
+  std::array<char, 4096> buffer;
+
+  static void handle(const int signum) noexcept {
+    const auto saved = errno;
+    const auto byte = static_cast<uint8_t>(signum);
+    [[maybe_unused]] const auto n = ::write(signal_pipe, &byte, 1);
+    errno = saved;
+  }
+
+public:
+  /** What one wait brought; empty when it timed out. */
+  struct events {
+    std::span<const char> input; // One read's worth.
+    bool end_of_input = false;
+    bool notified = false; // By `notify`.
+    uint64_t signals = 0;  // Bit n for each signal n caught.
+  };
+
+  event_loop() noexcept {
+    [[maybe_unused]] const auto created = ::pipe(pipe_fds.data());
+    assert(created == 0);
+    // Neither end may block: a full pipe already holds a wake-up, and a drained one is done.
+    for (const int fd : pipe_fds) {
+      fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) | O_NONBLOCK);
+      fcntl(fd, F_SETFD, FD_CLOEXEC);
+    }
+  }
+
+  event_loop(const event_loop &) = delete;
+  event_loop &operator=(const event_loop &) = delete;
+  ~event_loop() {
+    if (signal_pipe == pipe_fds[1]) {
+      signal_pipe = -1;
+    }
+    ::close(pipe_fds[0]);
+    ::close(pipe_fds[1]);
+  }
+
+  /** Makes `signals` wake the loop instead of acting by default; those ignored stay ignored. */
+  void catch_signals(const std::initializer_list<int> signals) noexcept {
+    assert(signal_pipe == -1 || signal_pipe == pipe_fds[1]);
+    signal_pipe = pipe_fds[1];
+    struct sigaction act{};
+    act.sa_handler = handle;
+    act.sa_flags = SA_RESTART;
+    sigemptyset(&act.sa_mask);
+    for (struct sigaction old{}; const int signum : signals) {
+      if (sigaction(signum, nullptr, &old) == 0 && old.sa_handler != SIG_IGN) {
+        sigaction(signum, &act, nullptr);
+      }
+    }
+  }
+
+  /** Wakes the loop; safe from any thread. */
+  void notify() noexcept {
+    const uint8_t byte = 0;
+    [[maybe_unused]] const auto n = ::write(pipe_fds[1], &byte, 1);
+  }
+
+  /** Waits until `fd` is readable, the loop is woken, or `timeout` passes, if there is one. */
+  events wait(const int fd, const std::optional<std::chrono::milliseconds> timeout) noexcept {
+    std::array<pollfd, 2> fds{{{fd, POLLIN, 0}, {pipe_fds[0], POLLIN, 0}}};
+    const auto ms =
+        timeout ? static_cast<int>(std::clamp<int64_t>(timeout->count(), 0, INT32_MAX)) : -1;
+    events happened;
+    if (::poll(fds.data(), fds.size(), ms) <= 0) {
+      return happened; // Timed out, or interrupted by a signal whose byte the next wait reads.
+    }
+    if (fds[1].revents & POLLIN) {
+      std::array<uint8_t, 64> bytes;
+      for (ssize_t n; (n = ::read(pipe_fds[0], bytes.data(), bytes.size())) > 0;) {
+        for (const auto b : std::span(bytes).first(n)) {
+          if (b == 0) {
+            happened.notified = true;
+          } else if (b < 64) {
+            happened.signals |= uint64_t{1} << b;
+          }
+        }
+      }
+    }
+    if (fds[0].revents & (POLLIN | POLLHUP | POLLERR)) {
+      const auto n = ::read(fd, buffer.data(), buffer.size());
+      if (n > 0) {
+        happened.input = std::span(buffer).first(n);
+      } else if (n == 0 || (errno != EINTR && errno != EAGAIN)) {
+        happened.end_of_input = true;
+      }
+    }
+    return happened;
+  }
+};
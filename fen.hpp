@@ -0,0 +1,417 @@
+// https://www.chessprogramming.org/Forsyth-Edwards_Notation
+// https://www.chessprogramming.org/Extended_Position_Description
+#pragma once
+#include "chess.hpp"
+#include <algorithm>
+#include <array>
+#include <optional>
+#include <span>
+#include <string_view>
+
+/** The move counters of a FEN record, which a configuration does not keep. */
+struct fen_counters {
+  unsigned halfmove_clock = 0;  // Plies since the last capture or pawn move.
+  unsigned fullmove_number = 1; // Incremented after each move of black.
+
+  /** Whether `m`, a move of `config`, resets the halfmove clock: a capture or a pawn move. */
+  template <class Side>
+  [[nodiscard]] static constexpr bool resets_clock(const basic_configuration<Side> &config,
+                                                   const move m) noexcept {
+    const auto &us = config.is_white_turn() ? config.get_white() : config.get_black();
+    const auto &them = config.is_white_turn() ? config.get_black() : config.get_white();
+    return m.dst(them) || us.get(m.get_src_square()) == piece::pawn;
+  }
+
+  /** Counts `m`, about to be played in `config`; whether it reset the halfmove clock. */
+  template <class Side>
+  constexpr bool advance(const basic_configuration<Side> &config, const move m) noexcept {
+    const bool reset = resets_clock(config, m);
+    halfmove_clock = reset ? 0 : halfmove_clock + 1;
+    fullmove_number += !config.is_white_turn();
+    return reset;
+  }
+};
+
+/** An opcode of an EPD record and its operands, as written and without the semicolon. */
+struct epd_operation {
+  std::string_view opcode, operands;
+};
+
+/** A position and the operations that follow it, which view the parsed line. */
+template <class Side = side> struct epd_record {
+  static constexpr size_t capacity = 16;
+
+  basic_configuration<Side> config;
+  std::array<epd_operation, capacity> operations;
+  size_t size;
+
+  [[nodiscard]] constexpr std::span<const epd_operation> get_operations() const noexcept {
+    return std::span(operations).first(size);
+  }
+
+  /** The operands of the first operation with `opcode`, if any. */
+  [[nodiscard]] constexpr std::optional<std::string_view>
+  find(const std::string_view opcode) const noexcept {
+    for (const auto &op : get_operations()) {
+      if (op.opcode == opcode) {
+        return op.operands;
+      }
+    }
+    return std::nullopt;
+  }
+};
+
+/** The longest FEN record `write_fen` writes, counters of any value included. */
+constexpr size_t max_fen_length = 64 + 7 + 2 + 5 + 3 + 2 * 11;
+
+namespace impl {
+
+// By piece, lower case.
+constexpr std::string_view fen_letters = ".prnbqk";
+
+// By character: the piece a letter stands for, upper case for white; empty for anything else.
+constexpr auto fen_pieces = [] {
+  std::array<piece, 256> pieces{};
+  for (size_t p = 1; p < fen_letters.size(); ++p) {
+    const auto letter = static_cast<unsigned char>(fen_letters[p]);
+    pieces[letter] = pieces[letter - 'a' + 'A'] = static_cast<piece>(p);
+  }
+  return pieces;
+}();
+
+/** Splits a record into its fields, which any number of spaces separate. */
+class fen_scanner {
+  const char *it, *end;
+
+public:
+  constexpr explicit fen_scanner(const std::string_view text) noexcept
+      : it(text.data()), end(text.data() + text.size()) {}
+
+  constexpr void skip_spaces() noexcept {
+    while (it != end && *it == ' ') {
+      ++it;
+    }
+  }
+
+  [[nodiscard]] constexpr std::string_view field() noexcept {
+    skip_spaces();
+    const std::string_view rest(it, end);
+    const auto field = rest.substr(0, rest.find(' '));
+    it += field.size();
+    return field;
+  }
+
+  [[nodiscard]] constexpr std::string_view rest() noexcept {
+    skip_spaces();
+    return {it, end};
+  }
+};
+
+/** A decimal number of at most 9 digits, all of `text`. */
+[[nodiscard]] constexpr std::optional<unsigned> parse_number(const std::string_view text) noexcept {
+  if (text.empty() || text.size() > 9) {
+    return std::nullopt;
+  }
+  unsigned n = 0;
+  for (const char ch : text) {
+    if (ch < '0' || '9' < ch) {
+      return std::nullopt;
+    }
+    n = n * 10 + (ch - '0');
+  }
+  return n;
+}
+
+/** The castling rights of `castling` whose king and rook are both still at home. */
+template <class Side>
+[[nodiscard]] constexpr uint8_t castling_kept(const Side &white, const Side &black,
+                                              uint8_t castling) noexcept {
+  // A right is void once its king or rook has left home.
+  constexpr auto at_home = [](const Side &side, const square king, const square rook) {
+    return side.get(king) == piece::king && side.get(rook) == piece::rook;
+  };
+  if (!at_home(white, 3, 0)) { // e1, h1
+    castling &= ~configuration::white_kingside;
+  }
+  if (!at_home(white, 3, 7)) { // e1, a1
+    castling &= ~configuration::white_queenside;
+  }
+  if (!at_home(black, 59, 56)) { // e8, h8
+    castling &= ~configuration::black_kingside;
+  }
+  if (!at_home(black, 59, 63)) { // e8, a8
+    castling &= ~configuration::black_queenside;
+  }
+  return castling;
+}
+
+/**
+ * Whether `target` can be the en passant square: behind a pawn of the side not to move, which
+ * has just stepped two squares from its home rank over it.
+ */
+template <class Side>
+[[nodiscard]] constexpr bool en_passant_possible(const Side &white, const Side &black,
+                                                 const bool white_turn,
+                                                 const square target) noexcept {
+  if (target / 8 != (white_turn ? 5 : 2)) {
+    return false;
+  }
+  const square pawn = white_turn ? target - 8 : target + 8;
+  const square home = white_turn ? target + 8 : target - 8;
+  const auto occupied = white.get_occupancy() | black.get_occupancy();
+  return (white_turn ? black : white).get(pawn) == piece::pawn &&
+         !(occupied & (uint64_t{1} << target | uint64_t{1} << home));
+}
+
+/** Parses the four fields of a position, which FEN and EPD records both start with. */
+template <class Side>
+[[nodiscard]] constexpr std::optional<basic_configuration<Side>>
+parse_position(fen_scanner &scanner) noexcept {
+  // Ranks 8 to 1, files a to h: the renderer's board order, from the most significant bit down.
+  // Each piece is thus below all those of its color before it, and takes the lowest nibble.
+  std::array<uint64_t, 2> occupancy{}, pieces{}; // By color: [black, white]
+  std::array<int, 2> count{};
+  int index = 0, ranks = 1; // Squares and ranks so far; each rank ends on a multiple of 8.
+  for (const char ch : scanner.field()) {
+    if (ch == '/') {
+      if (index != 8 * ranks || ++ranks > 8) {
+        return std::nullopt;
+      }
+      continue;
+    }
+    if ('1' <= ch && ch <= '8') {
+      index += ch - '0';
+      if (index > 8 * ranks) {
+        return std::nullopt;
+      }
+      continue;
+    }
+    const auto p = fen_pieces[static_cast<unsigned char>(ch)];
+    const bool is_white = !(ch & 0x20);
+    if (p == piece::empty || index >= 8 * ranks || count[is_white]++ == 16 ||
+        (p == piece::pawn && (ranks == 1 || ranks == 8))) {
+      return std::nullopt;
+    }
+    occupancy[is_white] |= uint64_t{1} << (63 ^ index++);
+    pieces[is_white] = pieces[is_white] << 4 | std::to_underlying(p);
+  }
+  if (ranks != 8 || index != 64) {
+    return std::nullopt;
+  }
+  const auto white = Side::from(occupancy[true], pieces[true]);
+  const auto black = Side::from(occupancy[false], pieces[false]);
+  if (std::popcount(white.get_bitboard(piece::king)) != 1 ||
+      std::popcount(black.get_bitboard(piece::king)) != 1) {
+    return std::nullopt;
+  }
+
+  const auto active = scanner.field();
+  if (active != "w" && active != "b") {
+    return std::nullopt;
+  }
+  const bool white_turn = active == "w";
+
+  uint8_t castling = 0;
+  if (const auto rights = scanner.field(); rights != "-") {
+    for (const char ch : rights) {
+      switch (ch) {
+      case 'K':
+        castling |= configuration::white_kingside;
+        break;
+      case 'Q':
+        castling |= configuration::white_queenside;
+        break;
+      case 'k':
+        castling |= configuration::black_kingside;
+        break;
+      case 'q':
+        castling |= configuration::black_queenside;
+        break;
+      default:
+        return std::nullopt;
+      }
+    }
+  }
+
+  castling = castling_kept(white, black, castling);
+
+  uint64_t en_passant = 0;
+  if (const auto target = scanner.field(); target != "-") {
+    if (target.size() != 2 || target[0] < 'a' || 'h' < target[0] || target[1] < '1' ||
+        '8' < target[1]) {
+      return std::nullopt;
+    }
+    const square s = (target[1] - '1') * 8 + ('h' - target[0]);
+    if (!en_passant_possible(white, black, white_turn, s)) {
+      return std::nullopt;
+    }
+    en_passant = uint64_t{1} << s;
+  }
+
+  return basic_configuration<Side>(white, black, white_turn, castling, en_passant);
+}
+
+} // namespace impl
+
+/**
+ * Parses a FEN record. The move counters may be left out, as some sources do, and are stored
+ * in `counters` if present; nothing else may follow.
+ */
+template <class Side = side>
+constexpr std::optional<basic_configuration<Side>> parse_fen(const std::string_view fen,
+                                                             fen_counters &counters) noexcept {
+  impl::fen_scanner scanner(fen);
+  const auto config = impl::parse_position<Side>(scanner);
+  if (!config) {
+    return std::nullopt;
+  }
+  fen_counters parsed;
+  if (const auto clock = scanner.field(); !clock.empty()) {
+    const auto halfmove = impl::parse_number(clock);
+    const auto fullmove = impl::parse_number(scanner.field());
+    if (!halfmove || !fullmove || *fullmove == 0) {
+      return std::nullopt;
+    }
+    parsed = {*halfmove, *fullmove};
+  }
+  if (!scanner.rest().empty()) {
+    return std::nullopt;
+  }
+  counters = parsed;
+  return config;
+}
+
+/** Parses a FEN record, whose move counters, if any, are checked and ignored. */
+template <class Side = side>
+constexpr std::optional<basic_configuration<Side>> parse_fen(const std::string_view fen) noexcept {
+  fen_counters counters;
+  return parse_fen<Side>(fen, counters);
+}
+
+/**
+ * Parses an EPD record: the four position fields of FEN, then operations such as
+ * `bm Nf3 e4;` or `id "WAC.001";`, at most `epd_record::capacity` of them. The operations view
+ * `epd`, which MUST outlive them.
+ */
+template <class Side = side>
+constexpr std::optional<epd_record<Side>> parse_epd(const std::string_view epd) noexcept {
+  impl::fen_scanner scanner(epd);
+  const auto config = impl::parse_position<Side>(scanner);
+  if (!config) {
+    return std::nullopt;
+  }
+  epd_record<Side> record{*config, {}, 0};
+  auto rest = scanner.rest();
+  while (!rest.empty()) {
+    const auto opcode = rest.substr(0, rest.find_first_of(" ;"));
+    if (record.size == record.capacity || opcode.empty() || (opcode[0] | 0x20) < 'a' ||
+        'z' < (opcode[0] | 0x20)) {
+      return std::nullopt;
+    }
+    // The operation ends at the first semicolon outside a string, or at the end of the line.
+    size_t i = opcode.size();
+    for (bool quoted = false; i < rest.size() && (quoted || rest[i] != ';'); ++i) {
+      quoted ^= rest[i] == '"';
+    }
+    auto operands = rest.substr(opcode.size(), i - opcode.size());
+    operands.remove_prefix(std::min(operands.find_first_not_of(' '), operands.size()));
+    operands.remove_suffix(operands.size() - (operands.find_last_not_of(' ') + 1));
+    record.operations[record.size++] = {opcode, operands};
+    rest.remove_prefix(std::min(i + 1, rest.size()));
+    rest.remove_prefix(std::min(rest.find_first_not_of(' '), rest.size()));
+  }
+  return record;
+}
+
+/**
+ * Writes the FEN record of `config` and `counters` to `out`, which MUST have room for
+ * `max_fen_length` characters, and returns the end of what it wrote. No null is appended.
+ */
+template <class Side>
+constexpr char *write_fen(const basic_configuration<Side> &config, char *out,
+                          const fen_counters counters = {}) noexcept {
+  // The letter on each square, upper case for white; null where empty.
+  std::array<char, 64> board{};
+  for (const auto [p, s] : config.get_white()) {
+    board[s] = static_cast<char>(impl::fen_letters[std::to_underlying(p)] - 'a' + 'A');
+  }
+  for (const auto [p, s] : config.get_black()) {
+    board[s] = impl::fen_letters[std::to_underlying(p)];
+  }
+  int empty = 0;
+  for (int index = 0; index < 64; ++index) {
+    if (const char letter = board[63 ^ index]) {
+      if (empty) {
+        *out++ = static_cast<char>('0' + empty);
+        empty = 0;
+      }
+      *out++ = letter;
+    } else {
+      ++empty;
+    }
+    if (index % 8 == 7) {
+      if (empty) {
+        *out++ = static_cast<char>('0' + empty);
+        empty = 0;
+      }
+      if (index != 63) {
+        *out++ = '/';
+      }
+    }
+  }
+
+  *out++ = ' ';
+  *out++ = config.is_white_turn() ? 'w' : 'b';
+
+  *out++ = ' ';
+  const auto castling = config.get_castling();
+  if (!castling) {
+    *out++ = '-';
+  }
+  for (const auto [right, letter] : {std::pair{configuration::white_kingside, 'K'},
+                                     std::pair{configuration::white_queenside, 'Q'},
+                                     std::pair{configuration::black_kingside, 'k'},
+                                     std::pair{configuration::black_queenside, 'q'}}) {
+    if (castling & right) {
+      *out++ = letter;
+    }
+  }
+
+  *out++ = ' ';
+  if (const auto en_passant = config.get_en_passant()) {
+    const auto s = std::countr_zero(en_passant);
+    *out++ = static_cast<char>('h' - s % 8);
+    *out++ = static_cast<char>('1' + s / 8);
+  } else {
+    *out++ = '-';
+  }
+
+  for (auto n : {counters.halfmove_clock, counters.fullmove_number}) {
+    *out++ = ' ';
+    std::array<char, 10> digits;
+    size_t count = 0;
+    do {
+      digits[count++] = static_cast<char>('0' + n % 10);
+      n /= 10;
+    } while (n);
+    while (count) {
+      *out++ = digits[--count];
+    }
+  }
+  return out;
+}
+
+static_assert([] {
+  constexpr std::string_view initial = "rnbqkbnr/pppppppp/8/8/8/8/PPPPPPPP/RNBQKBNR w KQkq - 0 1";
+  std::array<char, max_fen_length> buffer{};
+  const auto config = parse_fen(initial);
+  return config && config->get_key() == configuration().get_key() &&
+         std::string_view(buffer.data(), write_fen(*config, buffer.data())) == initial;
+}());
+static_assert(parse_fen("rnbqkbnr/pppppppp/8/8/4P3/8/PPPP1PPP/RNBQKBNR b KQkq e3 0 1"));
+static_assert(!parse_fen("4k3/8/8/3P4/8/8/8/4K3 w - e6 0 1"));    // No pawn to take.
+static_assert(!parse_fen("4k3/8/8/3Pp3/8/8/8/4K3 b - e6 0 1"));   // The wrong side to move.
+static_assert(!parse_fen("4k3/4p3/8/3Pp3/8/8/8/4K3 w - e6 0 1")); // Its home square is taken.
+static_assert(!parse_fen("8p7/8/8/8/8/8/4k2K w - - 0 1"));        // 7 ranks, one 16 wide.
+static_assert(!parse_fen("4k3/8/8/8/8/8/8/4K3/8 w - - 0 1"));     // 9 ranks.
+static_assert(!parse_fen("4k2P/8/8/8/8/8/8/4K3 w - - 0 1"));      // A pawn on the last rank.
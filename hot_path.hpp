@@ -0,0 +1,114 @@
+// Counters of what the primitives of chess.hpp do: how often each is called, why it gave up
+// early, how many steps its loops took. They are compiled in with -DHOT_PATH_COUNTERS and compiled
+// out otherwise, down to the last instruction.
+#pragma once
+#include <array>
+#include <cstdint>
+#include <string_view>
+#include <utility>
+#ifdef HOT_PATH_COUNTERS
+#include <atomic>
+#include <mutex>
+#include <vector>
+#endif
+
+namespace hot_path {
+
+enum class event : uint8_t {
+  iterator_step,           // `side::iterator` moved to the next piece.
+  king_square,             // `side::get_king_square`.
+  rook_attacks,            // `attacks::rook`, the queen's included.
+  bishop_attacks,          // `attacks::bishop`, the queen's included.
+  check,                   // Whether a king is attacked.
+  test_move,               // `basic_configuration::test_move`, then why it said no:
+  test_move_no_piece,      //   nothing on the source square;
+  test_move_promotion,     //   a pawn promoting off the last rank, or not promoting on it;
+  test_move_no_capture,    //   a pawn capturing nothing;
+  test_move_blocked,       //   a pawn advancing into a piece;
+  test_move_unreachable,   //   a destination the piece does not move to.
+  try_move,                // `basic_configuration::try_move`, then why it said no:
+  try_move_wrong_piece,    //   the source square holds another piece;
+  try_move_illegal,        //   the move is not among the legal ones.
+};
+
+constexpr std::array<std::string_view, 14> names{
+    "iterator_step",
+    "king_square",
+    "rook_attacks",
+    "bishop_attacks",
+    "check",
+    "test_move",
+    "test_move_no_piece",
+    "test_move_promotion",
+    "test_move_no_capture",
+    "test_move_blocked",
+    "test_move_unreachable",
+    "try_move",
+    "try_move_wrong_piece",
+    "try_move_illegal",
+};
+static_assert(names.size() == std::to_underlying(event::try_move_illegal) + 1);
+
+using totals = std::array<uint64_t, names.size()>;
+
+#ifdef HOT_PATH_COUNTERS
+constexpr bool enabled = true;
+
+namespace impl {
+
+// Each thread counts into a block of its own, with plain stores that no other thread contends
+// for; a sum reads every live block, plus what the threads that exited left behind.
+struct block;
+inline std::mutex mutex;
+inline std::vector<block *> live;
+inline totals retired{};
+
+struct block {
+  std::array<std::atomic<uint64_t>, names.size()> counts{};
+
+  block() {
+    const std::lock_guard lock(mutex);
+    live.push_back(this);
+  }
+  ~block() {
+    const std::lock_guard lock(mutex);
+    for (size_t i = 0; i < counts.size(); ++i) {
+      retired[i] += counts[i].load(std::memory_order_relaxed);
+    }
+    std::erase(live, this);
+  }
+};
+
+inline thread_local block local;
+
+} // namespace impl
+#else
+constexpr bool enabled = false;
+#endif
+
+/** Counts `e` once on the calling thread; a no-op without HOT_PATH_COUNTERS. */
+constexpr void count([[maybe_unused]] const event e) noexcept {
+#ifdef HOT_PATH_COUNTERS
+  if !consteval {
+    auto &c = impl::local.counts[std::to_underlying(e)];
+    c.store(c.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+  }
+#endif
+}
+
+/** The counts of every thread so far; all zero without HOT_PATH_COUNTERS. */
+inline totals collect() {
+  totals sum{};
+#ifdef HOT_PATH_COUNTERS
+  const std::lock_guard lock(impl::mutex);
+  sum = impl::retired;
+  for (const auto *const b : impl::live) {
+    for (size_t i = 0; i < sum.size(); ++i) {
+      sum[i] += b->counts[i].load(std::memory_order_relaxed);
+    }
+  }
+#endif
+  return sum;
+}
+
+} // namespace hot_path
@@ -0,0 +1,41 @@
+// The instruction sets that vector kernels are compiled for, and which of them the machine runs.
+// Each family of kernels is compiled with __attribute__((target(...))) and picks its kernels at
+// run time, so one binary runs everywhere.
+#pragma once
+#include <array>
+#include <utility>
+
+/** The instruction sets there are kernels for, narrowest first. */
+enum class isa { scalar, avx2, avx512 };
+
+constexpr std::array<const char *, 3> isa_names{"scalar", "avx2", "avx512"};
+
+/**
+ * Whether the machine runs kernels for `set`: AVX-512 means the foundation, AVX-512F, and also
+ * AVX-512BW where the kernels use its byte and word instructions.
+ */
+[[nodiscard]] inline bool runs_isa(const isa set, const bool avx512bw) noexcept {
+#if defined(__x86_64__) || defined(__i386__)
+  switch (set) {
+  case isa::scalar:
+    return true;
+  case isa::avx2:
+    return __builtin_cpu_supports("avx2");
+  case isa::avx512:
+    return __builtin_cpu_supports("avx512f") && (!avx512bw || __builtin_cpu_supports("avx512bw"));
+  }
+  std::unreachable();
+#else
+  return set == isa::scalar;
+#endif
+}
+
+/** The widest instruction set the machine runs, as `runs_isa` decides it. */
+[[nodiscard]] inline isa widest_isa(const bool avx512bw) noexcept {
+  for (const auto set : {isa::avx512, isa::avx2}) {
+    if (runs_isa(set, avx512bw)) {
+      return set;
+    }
+  }
+  return isa::scalar;
+}
@@ -0,0 +1,76 @@
+// A/B comparison of the two layouts of a side: `side` packs a color into 16 bytes, `wide_side`
+// keeps one bitboard per piece type. Both run the same configuration code over the same positions.
+#include "chess.hpp"
+#include "fen.hpp"
+#include "perft.hpp"
+#include <chrono>
+#include <iostream>
+#include <vector>
+
+template <class Side> uint64_t count_leaves(basic_configuration<Side> &config, const int depth,
+                                            ply_stack &plies) {
+  const auto moves = config.generate_legal_moves();
+  if (depth <= 1) {
+    return moves.size();
+  }
+  uint64_t nodes = 0;
+  for (const auto m : moves) {
+    config.make_move(m, plies);
+    nodes += count_leaves(config, depth - 1, plies);
+    config.unmake_move(plies);
+  }
+  return nodes;
+}
+
+/** Runs `f` over the corpus until a second has passed; returns nanoseconds per position. */
+double time_per_position(const auto &positions, auto &&f) {
+  const auto start = std::chrono::steady_clock::now();
+  std::chrono::duration<double, std::nano> elapsed{};
+  size_t visited = 0;
+  do {
+    for (const auto &config : positions) {
+      f(config);
+    }
+    visited += positions.size();
+    elapsed = std::chrono::steady_clock::now() - start;
+  } while (elapsed < std::chrono::seconds(1));
+  return elapsed.count() / visited;
+}
+
+template <class Side> void benchmark(const char *const name) {
+  const auto positions = corpus<Side>();
+  uint64_t checksum = 0;
+
+  const auto check_ns = time_per_position(
+      positions, [&checksum](const basic_configuration<Side> &config) {
+        checksum += config.in_check();
+      });
+  const auto generate_ns = time_per_position(
+      positions, [&checksum](const basic_configuration<Side> &config) {
+        checksum += config.generate_legal_moves().size();
+      });
+
+  ply_stack plies;
+  uint64_t nodes = 0;
+  const auto start = std::chrono::steady_clock::now();
+  for (const auto &r : references) {
+    auto config = *parse_fen<Side>(r.fen);
+    nodes += count_leaves(config, 4, plies);
+  }
+  const std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+
+  std::cout << name << ": " << sizeof(Side) << " bytes per side, "
+            << sizeof(basic_configuration<Side>) << " bytes per configuration\n"
+            << "  in_check:             " << check_ns << " ns\n"
+            << "  generate_legal_moves: " << generate_ns << " ns\n"
+            << "  perft 4:              " << nodes << " nodes, "
+            << static_cast<uint64_t>(nodes / elapsed.count()) << " nps\n"
+            << "  (" << positions.size() << " positions, checksum " << checksum << ")\n";
+}
+
+int main() {
+  std::cin.tie(nullptr)->sync_with_stdio(false);
+  benchmark<side>("side");
+  benchmark<wide_side>("wide_side");
+  std::cout << std::flush;
+}
@@ -0,0 +1,144 @@
+// https://www.chessprogramming.org/Lazy_SMP
+#pragma once
+#include "search.hpp"
+#include <condition_variable>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+/** Threads that outlive the jobs they run, so that every move does not pay for creating them. */
+class thread_pool {
+  std::mutex mutex;
+  std::condition_variable wake, done;
+  std::function<void(unsigned)> job;
+  unsigned width = 0, running = 0;
+  uint64_t generation = 0; // Jobs started so far; a worker runs each one at most once.
+  bool quitting = false;
+  std::vector<std::jthread> workers;
+
+  void work(const unsigned index) {
+    uint64_t seen = 0;
+    std::unique_lock lock(mutex);
+    for (;;) {
+      wake.wait(lock, [&] { return quitting || generation != seen; });
+      if (quitting) {
+        return;
+      }
+      seen = generation;
+      if (index >= width) {
+        continue;
+      }
+      lock.unlock();
+      job(index);
+      lock.lock();
+      if (--running == 0) {
+        done.notify_all();
+      }
+    }
+  }
+
+public:
+  explicit thread_pool(const unsigned threads) {
+    for (unsigned i = 0; i < threads; ++i) {
+      workers.emplace_back([this, i] { work(i); });
+    }
+  }
+
+  ~thread_pool() {
+    {
+      const std::lock_guard lock(mutex);
+      quitting = true;
+    }
+    wake.notify_all();
+  }
+
+  [[nodiscard]] unsigned size() const noexcept { return workers.size(); }
+
+  /** Runs `f(i)` on workers 0 to `threads - 1` at once, and returns when all are done. */
+  void run(const unsigned threads, std::function<void(unsigned)> f) {
+    assert(0 < threads && threads <= size());
+    std::unique_lock lock(mutex);
+    job = std::move(f);
+    width = running = threads;
+    ++generation;
+    wake.notify_all();
+    done.wait(lock, [this] { return running == 0; });
+  }
+};
+
+/**
+ * Searches the same root on several threads that share one transposition table: whatever one
+ * thread stores, the others find, which is all the cooperation there is. Thread 0 alone reports
+ * iterations and enforces the limits; when it is done, it stops the others.
+ */
+class lazy_smp {
+  transposition_table &table;
+  transposition_table::counters tally;
+  const nnue::network *network;
+  thread_pool pool;
+
+public:
+  /** Searches on `threads` threads, evaluating with `network` if there is one. */
+  lazy_smp(transposition_table &table, const unsigned threads,
+           const nnue::network *network = nullptr)
+      : table(table), network(network), pool(threads) {}
+
+  [[nodiscard]] unsigned size() const noexcept { return pool.size(); }
+
+  /**
+   * Like `searcher::search` on `threads` threads, at most `size()`. Reports carry the nodes of
+   * all threads. The result is that of the thread whose completed iteration is deepest, the
+   * lowest thread first among equals, so that it does not depend on which finished first.
+   * Raising `cancel` from another thread ends the search as a limit would.
+   */
+  search_result search(const configuration &root, const search_limits &limits, auto &&report,
+                       const std::vector<uint64_t> &history = {}, unsigned threads = 0,
+                       const std::atomic<bool> *const cancel = nullptr) {
+    threads = threads ? std::min(threads, size()) : size();
+    std::atomic<bool> stop = false;
+    std::vector<std::unique_ptr<searcher>> searchers;
+    for (unsigned i = 0; i < threads; ++i) {
+      searchers.push_back(
+          std::make_unique<searcher>(root, table, history, i == 0 ? cancel : &stop, network));
+    }
+    const auto total = [&searchers] {
+      uint64_t nodes = 0;
+      for (const auto &s : searchers) {
+        nodes += s->get_published_nodes();
+      }
+      return nodes;
+    };
+    std::vector<search_result> results(threads);
+    table.new_search();
+    pool.run(threads, [&](const unsigned i) {
+      if (i == 0) {
+        results[i] = searchers[i]->search(limits, [&](search_report r) {
+          r.nodes += total() - searchers[0]->get_published_nodes();
+          report(r);
+        });
+        stop.store(true, std::memory_order_relaxed);
+      } else {
+        results[i] = searchers[i]->search(limits, [](const search_report &) {}, i);
+      }
+    });
+    auto result = results[0];
+    uint64_t nodes = 0;
+    tally = {};
+    for (unsigned i = 0; i < threads; ++i) {
+      if (results[i].depth > result.depth) {
+        result = results[i];
+      }
+      nodes += results[i].nodes;
+      tally += searchers[i]->get_counters();
+    }
+    result.nodes = nodes;
+    return result;
+  }
+
+  /** Table probes of all threads during the last search. */
+  [[nodiscard]] const transposition_table::counters &get_counters() const noexcept {
+    return tally;
+  }
+};
@@ -1,72 +1,19 @@
 #include "ansi_escape_code.hpp"
+#include "arguments.hpp"
+#include "board_renderer.hpp"
 #include "chess.hpp"
+#include "event_loop.hpp"
+#include "fen.hpp"
+#include "lazy_smp.hpp"
+#include "uci.hpp"
+#include <atomic>
 #include <csignal>
 #include <iostream>
+#include <optional>
 #include <termios.h>
+#include <thread>
 #include <unistd.h>
-
-struct colored_piece {
-  piece piece;
-  bool is_white;
-};
-
-// https://stackoverflow.com/a/8327034
-std::ostream &operator<<(std::ostream &os, const colored_piece &cp) {
-  constexpr std::array fgcolors{
-      ansi::foreground_bright(ansi::color::green),
-      ansi::foreground_bright(ansi::color::white),
-  };
-  const auto fgcolor = fgcolors[cp.is_white];
-  switch (cp.piece) {
-  case piece::empty:
-    return os << fgcolor << "　";
-  case piece::pawn:
-    return os << fgcolor << (cp.is_white ? "Ｐ" : "ｐ");
-  case piece::rook:
-    return os << fgcolor << (cp.is_white ? "Ｒ" : "ｒ");
-  case piece::knight:
-    return os << fgcolor << (cp.is_white ? "Ｎ" : "ｎ");
-  case piece::bishop:
-    return os << fgcolor << (cp.is_white ? "Ｂ" : "ｂ");
-  case piece::queen:
-    return os << fgcolor << (cp.is_white ? "Ｑ" : "ｑ");
-  case piece::king:
-    return os << fgcolor << (cp.is_white ? "Ｋ" : "ｋ");
-  }
-}
-
-// https://askubuntu.com/a/558422
-std::ostream &operator<<(std::ostream &os, const configuration &config) {
-  std::array<piece, 64> board;
-  std::ranges::fill(board, piece::empty);
-  for (const auto [piece, shift] : config.get_white()) {
-    board[63 ^ shift] = piece;
-  }
-  for (const auto [piece, shift] : config.get_black()) {
-    board[63 ^ shift] = piece;
-  }
-  constexpr auto file_hint{"　ａｂｃｄｅｆｇｈ　"};
-  constexpr auto bgcolors = std::views::repeat(std::array{
-                                ansi::background_bright(ansi::color::blue),
-                                ansi::background_dark(ansi::color::blue),
-                            }) |
-                            std::views::join;
-  auto bgcolor = std::ranges::begin(bgcolors);
-  constexpr auto hint_color{"\033[0;49;90m"};
-  os << hint_color << file_hint << "\r\n";
-  auto square = board.cbegin();
-  auto pos = uint64_t{1} << 63;
-  for (const auto rank : {"８", "７", "６", "５", "４", "３", "２", "１"}) {
-    os << rank;
-    for (const auto _ : std::views::iota(0, 8)) {
-      os << *bgcolor++ << colored_piece(*square++, pos & config.get_white().get_occupancy());
-      pos >>= 1;
-    }
-    os << hint_color << rank << "\r\n";
-    ++bgcolor;
-  }
-  return os << file_hint << ansi::reset;
-}
+#include <vector>
 
 // Note that tcsetattr() returns success if any of the requested changes could be successfully
 // carried out. Therefore, when making multiple changes it may be necessary to follow this call with
@@ -86,58 +33,322 @@ void noecho() {
   assert(tcgetattr(STDIN_FILENO, &t) == 0);
   static const auto initial_termios = t;
   std::atexit([] {
-    std::cout << ansi::cursor_position(11, 1) << std::flush;
+    std::cout << ansi::cursor_show << ansi::cursor_position(12, 1) << std::flush;
     assert_tcsetattr(STDIN_FILENO, TCSAFLUSH, initial_termios);
   });
   cfmakeraw(&t);
   t.c_lflag |= ISIG;
   assert_tcsetattr(STDIN_FILENO, TCSAFLUSH, t);
+}
+
+/**
+ * A search of its own thread, which runs until a limit ends it or `finish` is called; with no
+ * limits, whoever started it decides when it is time. Once the search is over, `loop` is woken.
+ */
+class background_search {
+  std::atomic<bool> cancel = false, done = false;
+  search_result result{};
+  std::vector<move> pv; // Of the deepest completed iteration.
 
-  struct sigaction act{
-      .sa_handler = [](int) { exit(1); },
-      .sa_flags = 0,
-  };
-  assert(sigemptyset(&act.sa_mask) == 0);
-  for (struct sigaction oldact{}; const int signum : {SIGINT, SIGHUP, SIGTERM}) {
-    assert(sigaction(signum, nullptr, &oldact) == 0);
-    if (oldact.sa_handler != SIG_IGN) {
-      assert(sigaction(signum, &act, nullptr) == 0);
+public:
+  const configuration root;
+
+private:
+  std::jthread thread; // Last, so that it starts after the rest is constructed.
+
+public:
+  background_search(lazy_smp &engine, event_loop &loop, const configuration &root,
+                    const std::vector<uint64_t> &history, const search_limits &limits = {})
+      : root(root), thread([this, &engine, &loop, history, limits] {
+          result = engine.search(
+              this->root, limits, [this](const search_report &r) { pv = r.pv; }, history, 0,
+              &cancel);
+          done.store(true, std::memory_order_release);
+          loop.notify();
+        }) {}
+
+  background_search(const background_search &) = delete;
+  background_search &operator=(const background_search &) = delete;
+  ~background_search() { finish(); }
+
+  /** Whether the search is over by itself; `finish` then returns without waiting. */
+  [[nodiscard]] bool is_done() const noexcept { return done.load(std::memory_order_acquire); }
+
+  /** Ends the search, as soon as its threads notice, and returns what it found. */
+  const search_result &finish() {
+    cancel.store(true, std::memory_order_relaxed);
+    if (thread.joinable()) {
+      thread.join();
+    }
+    return result;
+  }
+
+  /** The principal variation; only once `finish` has returned. */
+  [[nodiscard]] const std::vector<move> &get_pv() const noexcept { return pv; }
+};
+
+/**
+ * The player has white and picks squares with their file and rank, or with the cursor keys,
+ * confirming each with enter: first the piece, then where it goes. The engine has black and
+ * thinks for a while on its own time, then, on the player's, about the position after the reply
+ * it expects: if that comes, the search goes on, already deep, for as long as a move takes;
+ * otherwise it is dropped, its table entries kept, for a search of the actual position.
+ */
+class game {
+  using clock = std::chrono::steady_clock;
+
+  lazy_smp &engine;
+  event_loop &loop;
+  const std::chrono::milliseconds think_time;
+  board_renderer renderer;
+  configuration config;
+  std::vector<uint64_t> keys; // Since the last capture or pawn move, oldest first.
+  std::optional<background_search> search;
+  bool pondering = false;                    // Whether `search` is on the player's time.
+  std::optional<clock::time_point> deadline; // When the engine has to move.
+  int file = 0, rank = 0;                    // Of the cursor, from 1; 0 before it is placed.
+  std::optional<square> from;                // The square of the piece the player picked.
+
+  [[nodiscard]] square cursor() const noexcept { return (rank - 1) * 8 + 8 - file; }
+
+  void show_cursor() const {
+    if (rank) {
+      std::cout << ansi::cursor_show << ansi::cursor_position(10 - rank, file * 2 + 1);
+    } else if (file) {
+      std::cout << ansi::cursor_show << ansi::cursor_position(10, file * 2 + 1);
+    } else {
+      std::cout << ansi::cursor_hide;
+    }
+    std::cout << std::flush;
+  }
+
+  void status(const auto &...text) const {
+    std::cout << ansi::cursor_save << ansi::cursor_position(11, 1) << ansi::clear_line;
+    (std::cout << ... << text) << ansi::cursor_restore << std::flush;
+  }
+
+  /** Plays `m` on `c`, keeping `k` the keys since the last capture or pawn move. */
+  static void advance(configuration &c, std::vector<uint64_t> &k, const move m) {
+    if (fen_counters::resets_clock(c, m)) {
+      k.clear();
+    } else {
+      k.push_back(c.get_key());
+    }
+    c = c.play(m);
+  }
+
+  /** Whether the game is over, then saying how. */
+  bool over() const {
+    if (!config.generate_legal_moves().empty()) {
+      return false;
+    }
+    status(config.in_check() ? (config.is_white_turn() ? "black wins" : "white wins")
+                             : "stalemate");
+    return true;
+  }
+
+  void think() {
+    search.emplace(engine, loop, config, keys);
+    pondering = false;
+    deadline = clock::now() + think_time;
+    status("thinking");
+  }
+
+  void reply() {
+    const auto found = search->finish();
+    const auto pv = search->get_pv();
+    search.reset();
+    deadline.reset();
+    const auto m = *found.best;
+    advance(config, keys, m);
+    renderer.draw(config);
+    status("black played ", m, ", depth ", found.depth, ", score ", found.score);
+    if (over()) {
+      return;
+    }
+    // Ponder the reply the search expects; without one, there is nothing better to do.
+    if (pv.size() < 2 || pv[0] != m || !config.is_legal(pv[1])) {
+      return;
+    }
+    auto expected = config;
+    auto expected_keys = keys;
+    advance(expected, expected_keys, pv[1]);
+    if (!expected.generate_legal_moves().empty()) {
+      search.emplace(engine, loop, expected, expected_keys);
+      pondering = true;
+    }
+  }
+
+  void play(const move m) {
+    advance(config, keys, m);
+    renderer.draw(config);
+    if (over()) {
+      search.reset();
+      return;
+    }
+    if (search && pondering && search->root.get_key() == config.get_key()) {
+      // Already searching the right position: it only has to stop in time now.
+      pondering = false;
+      deadline = clock::now() + think_time;
+      status("thinking, pondered");
+      if (search->is_done()) {
+        reply();
+      }
+    } else {
+      search.reset();
+      think();
     }
   }
-}
 
-void loop() {
-  int file = 0, rank = 0, col = 0;
-  for (char ch = '\0'; read(STDIN_FILENO, &ch, 1) == 1;) {
-    if ('a' <= ch && ch <= 'h') {
-      if (rank == 0) {
-        file = ch - 'a' + 1;
-        col = file * 2 + 1;
-        std::cout << ansi::cursor_show << ansi::cursor_position(10, col) << std::flush;
+  /** The square under the cursor was confirmed: the piece to move, or where to. */
+  void pick() {
+    const auto s = cursor();
+    const char name[]{static_cast<char>('a' + file - 1), static_cast<char>('0' + rank), '\0'};
+    file = rank = 0;
+    if (!from) {
+      if (config.get_white().get(s) != piece::empty) {
+        from = s;
+        status(name, " to where?");
       }
-    } else if ('1' <= ch && ch <= '8') {
-      if (file != 0) {
-        rank = ch - '1' + 1;
-        std::cout << ansi::cursor_position(10 - rank, col) << std::flush;
+      return;
+    }
+    // Of several promotions, the queen.
+    std::optional<move> found;
+    for (const auto m : config.generate_legal_moves()) {
+      if (m.get_src_square() == *from && m.get_dst_square() == s &&
+          (!found || m.get_promotion() == piece::queen)) {
+        found = m;
       }
+    }
+    from.reset();
+    if (found) {
+      play(*found);
     } else {
-      switch (ch) {
-      case '\n':
-        break;
-      case '\033':
-        file = rank = 0;
-        std::cout << ansi::cursor_hide << std::flush;
-        break;
+      status("illegal move");
+    }
+  }
+
+public:
+  game(lazy_smp &engine, event_loop &loop, const std::chrono::milliseconds think_time)
+      : engine(engine), loop(loop), think_time(think_time) {}
+
+  void redraw() {
+    std::cout << ansi::hard_clear_screen << std::flush;
+    renderer.invalidate();
+    renderer.draw(config);
+    show_cursor();
+  }
+
+  /** How long the loop may wait for input before it has something to do. */
+  [[nodiscard]] std::optional<std::chrono::milliseconds> timeout() const noexcept {
+    if (!deadline) {
+      return std::nullopt;
+    }
+    return std::chrono::ceil<std::chrono::milliseconds>(*deadline - clock::now());
+  }
+
+  /** The search is over, or the deadline may have passed. */
+  void tick() {
+    if (search && !pondering && (search->is_done() || clock::now() >= *deadline)) {
+      reply();
+      show_cursor();
+    }
+  }
+
+  void press(const key k) {
+    const bool thinking = search && !pondering;
+    switch (k.kind) {
+    case key::character:
+      if ('a' <= k.ch && k.ch <= 'h') {
+        file = k.ch - 'a' + 1;
+        rank = 0;
+      } else if ('1' <= k.ch && k.ch <= '8' && file) {
+        rank = k.ch - '1' + 1;
+      } else if ((k.ch == '\r' || k.ch == '\n') && rank && !thinking) {
+        pick();
+      }
+      break;
+    case key::escape:
+      file = rank = 0;
+      from.reset();
+      break;
+    case key::up:
+    case key::down:
+    case key::right:
+    case key::left:
+      if (!rank) {
+        file = file ? file : 5;
+        rank = 1;
+      } else {
+        file = std::clamp(file + (k.kind == key::right) - (k.kind == key::left), 1, 8);
+        rank = std::clamp(rank + (k.kind == key::up) - (k.kind == key::down), 1, 8);
       }
+      break;
+    case key::other:
+      break;
     }
+    show_cursor();
   }
-}
+};
 
-int main() {
+// main [-j threads] [-t milliseconds] [-H hash-megabytes]
+//   Plays white against the engine in the terminal. The engine thinks for a second a move by
+//   default, and on the player's time too.
+int main(const int argc, char *const argv[]) {
   std::cin.tie(nullptr)->sync_with_stdio(false);
+  unsigned threads = std::max(std::thread::hardware_concurrency(), 1U);
+  std::chrono::milliseconds::rep milliseconds = 1000;
+  size_t hash_megabytes = 64;
+  bool usage = false;
+  for (int opt; (opt = getopt(argc, argv, "j:t:H:")) != -1;) {
+    switch (opt) {
+    case 'j':
+      usage |= !parse(optarg, threads) || threads == 0;
+      break;
+    case 't':
+      usage |= !parse(optarg, milliseconds);
+      break;
+    case 'H':
+      usage |= !parse(optarg, hash_megabytes);
+      break;
+    default:
+      usage = true;
+    }
+  }
+  if (usage || optind != argc) {
+    std::cerr << "usage: " << argv[0] << " [-j threads] [-t milliseconds] [-H hash-megabytes]\n";
+    return 2;
+  }
+  transposition_table table(hash_megabytes);
+  lazy_smp engine(table, threads);
+  event_loop loop;
+  loop.catch_signals({SIGINT, SIGHUP, SIGTERM, SIGWINCH});
   noecho();
 
-  constexpr configuration config;
-  std::cout << ansi::hard_clear_screen << ansi::cursor_hide << config << std::flush;
-  loop();
+  game g(engine, loop, std::chrono::milliseconds(milliseconds));
+  g.redraw();
+  key_decoder decoder;
+  const auto press = [&g](const key k) { g.press(k); };
+  for (;;) {
+    auto timeout = g.timeout();
+    if (decoder.pending()) {
+      timeout = std::min(timeout.value_or(key_decoder::escape_timeout),
+                         key_decoder::escape_timeout);
+    }
+    const auto happened = loop.wait(STDIN_FILENO, timeout);
+    if (happened.signals & ~(uint64_t{1} << SIGWINCH)) {
+      return 1;
+    }
+    if (happened.end_of_input) {
+      return 0;
+    }
+    if (happened.signals) {
+      g.redraw();
+    }
+    decoder.feed(happened.input, press);
+    if (happened.input.empty() && !happened.notified && !happened.signals) {
+      decoder.flush(press); // Timed out: whatever is pending waited long enough.
+    }
+    g.tick();
+  }
 }
@@ -0,0 +1,67 @@
+// Files mapped read-only: pages are read in from the page cache as they are touched, shared by
+// every process that maps the same file, and nothing is copied.
+#pragma once
+#include <cstddef>
+#include <cstdio>
+#include <fcntl.h>
+#include <optional>
+#include <span>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <utility>
+
+/** A whole file mapped read-only for the lifetime of the object. */
+class mapped_file {
+  std::span<const std::byte> data;
+
+  explicit mapped_file(const std::span<const std::byte> data) noexcept : data(data) {}
+
+public:
+  /** Maps the file at `path`; nothing, the reason printed, if it cannot. */
+  [[nodiscard]] static std::optional<mapped_file> open(const char *const path) noexcept {
+    const int fd = ::open(path, O_RDONLY);
+    if (fd == -1) {
+      std::perror(path);
+      return std::nullopt;
+    }
+    struct stat status;
+    void *memory = MAP_FAILED;
+    size_t bytes = 0;
+    if (fstat(fd, &status) == 0) {
+      bytes = status.st_size;
+      // An empty file cannot be mapped, but has no bytes to read either.
+      memory = bytes ? mmap(nullptr, bytes, PROT_READ, MAP_PRIVATE, fd, 0) : nullptr;
+    }
+    close(fd);
+    if (memory == MAP_FAILED) {
+      std::perror(path);
+      return std::nullopt;
+    }
+    return mapped_file({static_cast<const std::byte *>(memory), bytes});
+  }
+
+  mapped_file(mapped_file &&other) noexcept : data(std::exchange(other.data, {})) {}
+  mapped_file(const mapped_file &) = delete;
+  mapped_file &operator=(const mapped_file &) = delete;
+  ~mapped_file() {
+    if (!data.empty()) {
+      munmap(const_cast<std::byte *>(data.data()), data.size());
+    }
+  }
+
+  [[nodiscard]] std::span<const std::byte> bytes() const noexcept { return data; }
+  [[nodiscard]] size_t size() const noexcept { return data.size(); }
+
+  /** The object of type `T` at `offset`, which the caller has checked lies within the file. */
+  template <class T> [[nodiscard]] const T *at(const size_t offset) const noexcept {
+    return reinterpret_cast<const T *>(data.data() + offset);
+  }
+
+  /** Tells the kernel how the pages will be read, as madvise(2) takes it. */
+  void advise(const int advice) const noexcept {
+    if (!data.empty()) {
+      madvise(const_cast<std::byte *>(data.data()), data.size(), advice);
+    }
+  }
+};
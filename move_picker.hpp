@@ -0,0 +1,233 @@
+// https://www.chessprogramming.org/Move_Ordering
+#pragma once
+#include "chess.hpp"
+#include "evaluation.hpp"
+#include <optional>
+
+/**
+ * The material the side to move wins by playing the capture `m` and then trading on its
+ * destination square, both sides always recapturing with their least valuable piece and either
+ * free to stop. Sliders behind a capturer join in as soon as it has left.
+ * https://www.chessprogramming.org/Static_Exchange_Evaluation
+ */
+template <class Side>
+[[nodiscard]] constexpr int static_exchange(const basic_configuration<Side> &config,
+                                            const move m) noexcept {
+  // Taking a king ends the game; it is worth more than everything else together.
+  constexpr auto worth = [](const piece p) {
+    return p == piece::king ? 20'000 : evaluation::value[std::to_underlying(p)];
+  };
+  const auto &white = config.get_white(), &black = config.get_black();
+  const auto target = m.get_dst_square();
+  const auto bitboard = [&](const piece p) {
+    return white.get_bitboard(p) | black.get_bitboard(p);
+  };
+  const auto orthogonal = bitboard(piece::rook) | bitboard(piece::queen);
+  const auto diagonal = bitboard(piece::bishop) | bitboard(piece::queen);
+  const auto attackers = [&](const uint64_t occupied) {
+    // A pawn attacks the target from where a pawn of the other color on the target would capture.
+    return ((attacks::pawn(target, false) & white.get_bitboard(piece::pawn)) |
+            (attacks::pawn(target, true) & black.get_bitboard(piece::pawn)) |
+            (attacks::knight(target) & bitboard(piece::knight)) |
+            (attacks::king(target) & bitboard(piece::king)) |
+            (attacks::rook(target, occupied) & orthogonal) |
+            (attacks::bishop(target, occupied) & diagonal)) &
+           occupied;
+  };
+
+  const bool is_white = config.is_white_turn();
+  auto mover = (is_white ? white : black).get(m.get_src_square());
+  auto victim = (is_white ? black : white).get(target);
+  if (mover == piece::pawn && m.dst(config.get_en_passant())) {
+    return 0; // Pawn for pawn, with the captured pawn off the target square; call it even.
+  }
+  std::array<int, 32> gain;
+  gain[0] = worth(victim) + (m.get_promotion() == piece::empty
+                                 ? 0
+                                 : worth(m.get_promotion()) - worth(piece::pawn));
+  if (m.get_promotion() != piece::empty) {
+    mover = m.get_promotion();
+  }
+  auto occupied = (white.get_occupancy() ^ black.get_occupancy()) ^ m.src();
+  bool white_to_capture = !is_white;
+  size_t depth = 0;
+  for (;;) {
+    ++depth;
+    // What the side to capture has after taking the piece just moved onto the target.
+    gain[depth] = worth(mover) - gain[depth - 1];
+    if (std::max(-gain[depth - 1], gain[depth]) < 0) {
+      break; // Neither taking nor stopping can change the sign of the outcome.
+    }
+    const auto own = (white_to_capture ? white : black).get_occupancy() & attackers(occupied);
+    if (!own) {
+      break;
+    }
+    mover = piece::empty;
+    for (const auto p : {piece::pawn, piece::knight, piece::bishop, piece::rook, piece::queen,
+                         piece::king}) {
+      if (const auto candidates = own & bitboard(p)) {
+        mover = p;
+        occupied ^= candidates & -candidates;
+        break;
+      }
+    }
+    white_to_capture = !white_to_capture;
+    if (depth + 1 == gain.size()) {
+      break;
+    }
+  }
+  while (--depth) {
+    gain[depth - 1] = -std::max(-gain[depth - 1], gain[depth]);
+  }
+  return gain[0];
+}
+
+/** Quiet moves that caused cutoffs, by color, source and destination square. */
+using history_table = std::array<std::array<std::array<int, 64>, 64>, 2>;
+
+/**
+ * Yields the legal moves of a configuration one by one, each stage generated only when the ones
+ * before it fail to cut off: the table's move, winning and even captures by most valuable victim
+ * then least valuable attacker, the killers, quiet moves by history, and losing captures last.
+ */
+class move_picker {
+  enum class stage {
+    hash,
+    generate_captures,
+    good_captures,
+    killers,
+    generate_quiets,
+    quiets,
+    bad_captures,
+    done,
+  };
+
+  const configuration &config;
+  stage current;
+  std::optional<move> hash;
+  std::array<move, 2> killers;
+  const history_table *history;
+  move_list captures, quiets;
+  std::array<int, 256> scores;
+  size_t index = 0, bad = 0; // captures[0, bad) lost material; captures[index, ...) are left.
+
+  /** Swaps the best scored of moves[index, ...) into moves[index] and returns it. */
+  [[nodiscard]] move pick(move_list &moves) noexcept {
+    auto best = index;
+    for (auto i = index + 1; i < moves.size(); ++i) {
+      if (scores[i] > scores[best]) {
+        best = i;
+      }
+    }
+    std::swap(moves[index], moves[best]);
+    std::swap(scores[index], scores[best]);
+    return moves[index++];
+  }
+
+  [[nodiscard]] bool is_killer(const move m) const noexcept {
+    return m == killers[0] || m == killers[1];
+  }
+
+public:
+  /**
+   * Every legal move, in stages. `killers` hold quiet moves that cut off at the same ply of
+   * sibling nodes, move(0, 0) where there are none.
+   */
+  move_picker(const configuration &config, const std::optional<move> hash,
+              const std::array<move, 2> &killers, const history_table &history) noexcept
+      : config(config), current(stage::hash), hash(hash), killers(killers), history(&history) {}
+
+  /** Only the captures and promotions that do not lose material, for a quiescence search. */
+  explicit move_picker(const configuration &config) noexcept
+      : config(config), current(stage::generate_captures), killers{}, history(nullptr) {}
+
+  /** The next move to search; nothing once all are done. */
+  [[nodiscard]] std::optional<move> next() noexcept {
+    switch (current) {
+    case stage::hash:
+      current = stage::generate_captures;
+      if (hash && config.is_legal(*hash)) {
+        return hash;
+      }
+      [[fallthrough]];
+    case stage::generate_captures: {
+      captures = config.generate_legal_moves<move_kind::noisy>();
+      const auto &us = config.is_white_turn() ? config.get_white() : config.get_black();
+      const auto &them = config.is_white_turn() ? config.get_black() : config.get_white();
+      for (size_t i = 0; i < captures.size(); ++i) {
+        const auto m = captures[i];
+        // An empty destination is a promotion or en passant; values are indexed by `piece`.
+        const auto victim = std::max(them.get(m.get_dst_square()), piece::pawn);
+        const auto attacker = us.get(m.get_src_square());
+        scores[i] = 8 * evaluation::value[std::to_underlying(victim)] +
+                    evaluation::value[std::to_underlying(m.get_promotion())] -
+                    evaluation::value[std::to_underlying(attacker)] / 10;
+      }
+      current = stage::good_captures;
+      [[fallthrough]];
+    }
+    case stage::good_captures:
+      while (index < captures.size()) {
+        const auto m = pick(captures);
+        if (m == hash) {
+          continue;
+        }
+        // Exchanges are only worked out for the moves that get this far.
+        if (m.get_promotion() != piece::queen && static_exchange(config, m) < 0) {
+          captures[bad++] = m;
+          continue;
+        }
+        return m;
+      }
+      if (!history) {
+        current = stage::done;
+        return std::nullopt;
+      }
+      current = stage::killers;
+      index = 0;
+      [[fallthrough]];
+    case stage::killers:
+      while (index < killers.size()) {
+        auto &m = killers[index++];
+        // A killer that is a capture here already came with the captures.
+        if (m != hash && m != move(0, 0) && !m.dst(config.get_white()) &&
+            !m.dst(config.get_black()) && !m.dst(config.get_en_passant()) &&
+            m.get_promotion() == piece::empty && config.is_legal(m)) {
+          return m;
+        }
+        m = move(0, 0); // Not played as a killer, so the quiet moves must not skip it.
+      }
+      current = stage::generate_quiets;
+      [[fallthrough]];
+    case stage::generate_quiets: {
+      quiets = config.generate_legal_moves<move_kind::quiet>();
+      const auto &table = (*history)[config.is_white_turn()];
+      for (size_t i = 0; i < quiets.size(); ++i) {
+        scores[i] = table[quiets[i].get_src_square()][quiets[i].get_dst_square()];
+      }
+      index = 0;
+      current = stage::quiets;
+      [[fallthrough]];
+    }
+    case stage::quiets:
+      while (index < quiets.size()) {
+        const auto m = pick(quiets);
+        if (m != hash && !is_killer(m)) {
+          return m;
+        }
+      }
+      current = stage::bad_captures;
+      index = 0;
+      [[fallthrough]];
+    case stage::bad_captures:
+      if (index < bad) {
+        return captures[index++];
+      }
+      current = stage::done;
+      [[fallthrough]];
+    case stage::done:
+      return std::nullopt;
+    }
+    std::unreachable();
+  }
+};
@@ -0,0 +1,144 @@
+// Checks and times the kernels of a network: incremental updates against refreshes, and every
+// instruction set the machine supports against the portable kernels, which must agree exactly.
+#include "arguments.hpp"
+#include "chess.hpp"
+#include "fen.hpp"
+#include "nnue.hpp"
+#include "perft.hpp"
+#include <chrono>
+#include <iostream>
+#include <unistd.h>
+#include <vector>
+
+/** Pseudorandom weights, small enough that the accumulators stay within the clamped range. */
+bool write_random(const char *const path, uint64_t seed) {
+  const auto next = [&seed](const int bound) {
+    return static_cast<int>(splitmix64(seed) % (2 * bound + 1)) - bound;
+  };
+  std::vector<int16_t> ft_weights(nnue::features * nnue::width), ft_bias(nnue::width);
+  std::vector<int8_t> l1_weights(nnue::hidden * 2 * nnue::width), out_weights(nnue::hidden);
+  std::vector<int32_t> l1_bias(nnue::hidden);
+  for (auto &w : ft_weights) {
+    w = next(8);
+  }
+  for (auto &b : ft_bias) {
+    b = 64 + next(32);
+  }
+  for (auto &w : l1_weights) {
+    w = next(32);
+  }
+  for (auto &b : l1_bias) {
+    b = next(1 << 12);
+  }
+  for (auto &w : out_weights) {
+    w = next(64);
+  }
+  return nnue::network::save(path, ft_weights, ft_bias, l1_weights, l1_bias, out_weights, 0);
+}
+
+/** Moves and the positions they lead from and to. */
+struct walk {
+  std::vector<configuration> before, after;
+  std::vector<move> moves;
+};
+
+void visit(walk &w, const configuration &config, const int depth) {
+  if (depth == 0) {
+    return;
+  }
+  for (const auto m : config.generate_legal_moves()) {
+    const auto child = config.play(m);
+    w.before.push_back(config);
+    w.after.push_back(child);
+    w.moves.push_back(m);
+    visit(w, child, depth - 1);
+  }
+}
+
+/** Every move within 3 plies of the reference positions. */
+walk corpus() {
+  walk w;
+  for (const auto &r : references) {
+    visit(w, *parse_fen(r.fen), 3);
+  }
+  return w;
+}
+
+// nnue [-r seed] network
+//   -r  first write a network of pseudorandom weights drawn from `seed` to the file.
+//   Exits with status 1 if any kernel or incremental update disagrees.
+int main(const int argc, char *const argv[]) {
+  std::cin.tie(nullptr)->sync_with_stdio(false);
+  std::optional<uint64_t> seed;
+  bool usage = false;
+  for (int opt; (opt = getopt(argc, argv, "r:")) != -1;) {
+    switch (opt) {
+    case 'r':
+      seed.emplace();
+      usage |= !parse(optarg, *seed);
+      break;
+    default:
+      usage = true;
+    }
+  }
+  if (usage || optind + 1 != argc) {
+    std::cerr << "usage: " << argv[0] << " [-r seed] network\n";
+    return 2;
+  }
+  const char *const path = argv[optind];
+  if (seed && !write_random(path, *seed)) {
+    return 1;
+  }
+  auto network = nnue::network::load(path);
+  if (!network) {
+    return 1;
+  }
+
+  const auto w = corpus();
+  const auto n = w.moves.size();
+  std::vector<nnue::accumulator> parents(n), children(n), refreshed(n);
+  network->select(isa::scalar);
+  for (size_t i = 0; i < n; ++i) {
+    network->refresh(parents[i], w.before[i]);
+    network->refresh(refreshed[i], w.after[i]);
+  }
+  std::vector<int> expected(n);
+  for (size_t i = 0; i < n; ++i) {
+    expected[i] = network->evaluate(refreshed[i], w.after[i].is_white_turn());
+  }
+
+  bool ok = true;
+  for (const auto set : {isa::scalar, isa::avx2, isa::avx512}) {
+    const auto name = isa_names[std::to_underlying(set)];
+    if (!nnue::supported(set)) {
+      std::cout << name << ": not supported\n";
+      continue;
+    }
+    network->select(set);
+    size_t mismatches = 0;
+    for (size_t i = 0; i < n; ++i) {
+      network->update(parents[i], children[i], w.before[i], w.moves[i], w.after[i]);
+      const bool same = children[i].values == refreshed[i].values &&
+                        network->evaluate(children[i], w.after[i].is_white_turn()) == expected[i];
+      mismatches += !same;
+    }
+    ok &= mismatches == 0;
+
+    using nanoseconds = std::chrono::duration<double, std::nano>;
+    auto start = std::chrono::steady_clock::now();
+    for (size_t i = 0; i < n; ++i) {
+      network->update(parents[i], children[i], w.before[i], w.moves[i], w.after[i]);
+    }
+    const nanoseconds update = (std::chrono::steady_clock::now() - start) / n;
+    int64_t checksum = 0;
+    start = std::chrono::steady_clock::now();
+    for (size_t i = 0; i < n; ++i) {
+      checksum += network->evaluate(children[i], w.after[i].is_white_turn());
+    }
+    const nanoseconds evaluate = (std::chrono::steady_clock::now() - start) / n;
+    std::cout << name << ": " << mismatches << " mismatches, update " << update.count()
+              << " ns, evaluate " << evaluate.count() << " ns (checksum " << checksum << ")\n";
+  }
+  std::cout << n << " moves checked" << std::endl;
+  return ok ? 0 : 1;
+}
@@ -0,0 +1,393 @@
+// https://www.chessprogramming.org/NNUE
+#pragma once
+#include "chess.hpp"
+#include "isa.hpp"
+#include "mapped_file.hpp"
+#include <algorithm>
+#include <bit>
+#include <cstdio>
+#include <optional>
+#include <span>
+#include <sys/mman.h>
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#endif
+
+/**
+ * An efficiently updatable neural network: each color sees the board as pieces relative to its
+ * own king, and the first layer's sums over those features are kept up to date move by move
+ * instead of being computed anew. Only the small layers after it run per evaluation.
+ *
+ *   features   64 king squares x 10 pieces (5 types, own or other color) x 64 squares, of which
+ *              the pieces other than kings are set; black sees the board flipped.
+ *   layer 1    features -> 128 int16 per color, the accumulator.
+ *   layer 2    both accumulators clamped to [0, 127], side to move first -> 32 int8 weights,
+ *              int32 sums shifted right by 6 and clamped to [0, 127].
+ *   output     32 int8 weights -> int32, divided by 16 into centipawns for the side to move.
+ *
+ * Everything is integer arithmetic, so the vector kernels compute exactly what the portable
+ * ones do.
+ */
+namespace nnue {
+
+constexpr size_t features = 64 * 10 * 64, width = 128, hidden = 32;
+
+/** The first layer's sums of one position, by color, updated along with the configuration. */
+struct alignas(64) accumulator {
+  std::array<std::array<int16_t, width>, 2> values; // [black, white]
+};
+
+/** The index of the feature a piece is to the color `perspective`, whose king is on `king`. */
+[[nodiscard]] constexpr size_t feature(const bool perspective, const square king,
+                                       const bool is_white, const piece p,
+                                       const square s) noexcept {
+  assert(p != piece::empty && p != piece::king);
+  const auto orient = [perspective](const square x) -> size_t { return perspective ? x : x ^ 56; };
+  const size_t kind = 2 * (std::to_underlying(p) - 1) + (is_white != perspective);
+  return (orient(king) * 10 + kind) * 64 + orient(s);
+}
+static_assert(feature(true, 3, true, piece::pawn, 11) == (3 * 10 + 0) * 64 + 11);
+static_assert(feature(false, 59, true, piece::pawn, 11) == (3 * 10 + 1) * 64 + 51);
+
+namespace impl {
+
+using rows = std::span<const int16_t *const>;
+
+// dst = src + the sum of `added` - the sum of `removed`, wrapping around like the vector lanes.
+inline void update_scalar(int16_t *const dst, const int16_t *const src, const rows added,
+                          const rows removed) noexcept {
+  std::array<int16_t, width> sums;
+  std::copy_n(src, width, sums.begin());
+  for (const auto row : added) {
+    for (size_t i = 0; i < width; ++i) {
+      sums[i] = static_cast<int16_t>(sums[i] + row[i]);
+    }
+  }
+  for (const auto row : removed) {
+    for (size_t i = 0; i < width; ++i) {
+      sums[i] = static_cast<int16_t>(sums[i] - row[i]);
+    }
+  }
+  std::ranges::copy(sums, dst);
+}
+
+// out[j] = bias[j] + the dot product of `input` with row j of `weights`, for the hidden layer.
+inline void dense_scalar(int32_t *const out, const int16_t *const input,
+                         const int8_t *const weights, const int32_t *const bias) noexcept {
+  for (size_t j = 0; j < hidden; ++j) {
+    int32_t sum = bias[j];
+    for (size_t i = 0; i < 2 * width; ++i) {
+      sum += input[i] * weights[j * 2 * width + i];
+    }
+    out[j] = sum;
+  }
+}
+
+#if defined(__x86_64__) || defined(__i386__)
+
+__attribute__((target("avx2"))) inline void update_avx2(int16_t *const dst,
+                                                        const int16_t *const src, const rows added,
+                                                        const rows removed) noexcept {
+  constexpr size_t lanes = 16;
+  __m256i sums[width / lanes];
+  for (size_t i = 0; i < width / lanes; ++i) {
+    sums[i] = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(src + i * lanes));
+  }
+  for (const auto row : added) {
+    for (size_t i = 0; i < width / lanes; ++i) {
+      sums[i] = _mm256_add_epi16(
+          sums[i], _mm256_loadu_si256(reinterpret_cast<const __m256i *>(row + i * lanes)));
+    }
+  }
+  for (const auto row : removed) {
+    for (size_t i = 0; i < width / lanes; ++i) {
+      sums[i] = _mm256_sub_epi16(
+          sums[i], _mm256_loadu_si256(reinterpret_cast<const __m256i *>(row + i * lanes)));
+    }
+  }
+  for (size_t i = 0; i < width / lanes; ++i) {
+    _mm256_storeu_si256(reinterpret_cast<__m256i *>(dst + i * lanes), sums[i]);
+  }
+}
+
+// The int8 weights are widened to int16 rather than multiplied with maddubs, which saturates.
+// Four rows at a time, whose sums are reduced together.
+__attribute__((target("avx2"))) inline void dense_avx2(int32_t *const out,
+                                                      const int16_t *const input,
+                                                      const int8_t *const weights,
+                                                      const int32_t *const bias) noexcept {
+  for (size_t j = 0; j < hidden; j += 4) {
+    __m256i sums[4];
+    for (size_t k = 0; k < 4; ++k) {
+      sums[k] = _mm256_setzero_si256();
+      const auto row = weights + (j + k) * 2 * width;
+      for (size_t i = 0; i < 2 * width; i += 16) {
+        const auto w =
+            _mm256_cvtepi8_epi16(_mm_loadu_si128(reinterpret_cast<const __m128i *>(row + i)));
+        const auto x = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(input + i));
+        sums[k] = _mm256_add_epi32(sums[k], _mm256_madd_epi16(x, w));
+      }
+    }
+    const auto quad = _mm256_hadd_epi32(_mm256_hadd_epi32(sums[0], sums[1]),
+                                        _mm256_hadd_epi32(sums[2], sums[3]));
+    const auto total = _mm_add_epi32(_mm256_castsi256_si128(quad),
+                                     _mm256_extracti128_si256(quad, 1));
+    _mm_storeu_si128(reinterpret_cast<__m128i *>(out + j),
+                     _mm_add_epi32(total, _mm_loadu_si128(
+                                              reinterpret_cast<const __m128i *>(bias + j))));
+  }
+}
+
+__attribute__((target("avx512f,avx512bw"))) inline void
+update_avx512(int16_t *const dst, const int16_t *const src, const rows added,
+              const rows removed) noexcept {
+  constexpr size_t lanes = 32;
+  __m512i sums[width / lanes];
+  for (size_t i = 0; i < width / lanes; ++i) {
+    sums[i] = _mm512_loadu_si512(src + i * lanes);
+  }
+  for (const auto row : added) {
+    for (size_t i = 0; i < width / lanes; ++i) {
+      sums[i] = _mm512_add_epi16(sums[i], _mm512_loadu_si512(row + i * lanes));
+    }
+  }
+  for (const auto row : removed) {
+    for (size_t i = 0; i < width / lanes; ++i) {
+      sums[i] = _mm512_sub_epi16(sums[i], _mm512_loadu_si512(row + i * lanes));
+    }
+  }
+  for (size_t i = 0; i < width / lanes; ++i) {
+    _mm512_storeu_si512(dst + i * lanes, sums[i]);
+  }
+}
+
+__attribute__((target("avx512f,avx512bw"))) inline void
+dense_avx512(int32_t *const out, const int16_t *const input, const int8_t *const weights,
+             const int32_t *const bias) noexcept {
+  __m512i x[2 * width / 32];
+  for (size_t i = 0; i < 2 * width / 32; ++i) {
+    x[i] = _mm512_loadu_si512(input + i * 32);
+  }
+  for (size_t j = 0; j < hidden; ++j) {
+    __m512i sum = _mm512_setzero_si512();
+    const auto row = weights + j * 2 * width;
+    for (size_t i = 0; i < 2 * width / 32; ++i) {
+      const auto w = _mm512_cvtepi8_epi16(
+          _mm256_loadu_si256(reinterpret_cast<const __m256i *>(row + i * 32)));
+      sum = _mm512_add_epi32(sum, _mm512_madd_epi16(x[i], w));
+    }
+    out[j] = bias[j] + _mm512_reduce_add_epi32(sum);
+  }
+}
+
+#endif
+
+struct kernels {
+  void (*update)(int16_t *, const int16_t *, rows, rows) noexcept;
+  void (*dense)(int32_t *, const int16_t *, const int8_t *, const int32_t *) noexcept;
+};
+
+#if defined(__x86_64__) || defined(__i386__)
+constexpr std::array<kernels, 3> by_isa{kernels{update_scalar, dense_scalar},
+                                        kernels{update_avx2, dense_avx2},
+                                        kernels{update_avx512, dense_avx512}};
+#else
+constexpr std::array<kernels, 3> by_isa{kernels{update_scalar, dense_scalar},
+                                        kernels{update_scalar, dense_scalar},
+                                        kernels{update_scalar, dense_scalar}};
+#endif
+
+// The file: a 64-byte header, then each layer's weights and biases, little endian.
+constexpr std::array<char, 8> magic{'C', 'H', 'E', 'S', 'S', 'N', 'N', '1'};
+constexpr size_t header = 64;
+constexpr size_t ft_weights = header, ft_bias = ft_weights + features * width * sizeof(int16_t),
+                 l1_weights = ft_bias + width * sizeof(int16_t),
+                 l1_bias = l1_weights + hidden * 2 * width * sizeof(int8_t),
+                 out_weights = l1_bias + hidden * sizeof(int32_t),
+                 out_bias = out_weights + hidden * sizeof(int8_t),
+                 file_size = out_bias + sizeof(int32_t);
+static_assert(ft_weights % 64 == 0 && l1_bias % alignof(int32_t) == 0 &&
+              out_bias % alignof(int32_t) == 0);
+static_assert(std::endian::native == std::endian::little);
+
+} // namespace impl
+
+/** Whether the machine runs the kernels of `set`, whose 16-bit lanes need AVX-512BW. */
+[[nodiscard]] inline bool supported(const isa set) noexcept { return runs_isa(set, true); }
+
+/** The widest instruction set the machine runs the kernels of. */
+[[nodiscard]] inline isa best_isa() noexcept { return widest_isa(true); }
+
+/** Weights mapped read-only from a file, shared by every thread that evaluates with them. */
+class network {
+  mapped_file file;
+  const int16_t *ft_weights, *ft_bias;
+  const int8_t *l1_weights, *out_weights;
+  const int32_t *l1_bias, *out_bias;
+  const impl::kernels *kernels = &impl::by_isa[std::to_underlying(best_isa())];
+
+  explicit network(mapped_file &&mapped) noexcept
+      : file(std::move(mapped)), ft_weights(file.at<int16_t>(impl::ft_weights)),
+        ft_bias(file.at<int16_t>(impl::ft_bias)), l1_weights(file.at<int8_t>(impl::l1_weights)),
+        out_weights(file.at<int8_t>(impl::out_weights)),
+        l1_bias(file.at<int32_t>(impl::l1_bias)), out_bias(file.at<int32_t>(impl::out_bias)) {}
+
+  [[nodiscard]] const int16_t *row(const size_t feature) const noexcept {
+    return ft_weights + feature * width;
+  }
+
+public:
+  /** Maps the network in the file at `path`; nothing if it cannot or the file is no network. */
+  [[nodiscard]] static std::optional<network> load(const char *const path) noexcept {
+    auto file = mapped_file::open(path);
+    if (!file) {
+      return std::nullopt;
+    }
+    if (file->size() != impl::file_size ||
+        !std::equal(impl::magic.begin(), impl::magic.end(), file->at<char>(0))) {
+      std::fprintf(stderr, "%s: not a network of this architecture\n", path);
+      return std::nullopt;
+    }
+    file->advise(MADV_WILLNEED);
+    return network(std::move(*file));
+  }
+
+  // The weights stay where they are mapped, so the pointers into them move along.
+  network(network &&) noexcept = default;
+  network(const network &) = delete;
+  network &operator=(const network &) = delete;
+
+  /** Switches the kernels to those of `set`, which the machine MUST support. */
+  void select(const isa set) noexcept {
+    assert(supported(set));
+    kernels = &impl::by_isa[std::to_underlying(set)];
+  }
+
+  /** Computes the accumulator of color `perspective` from scratch. */
+  void refresh(accumulator &acc, const configuration &config,
+               const bool perspective) const noexcept {
+    const auto king = (perspective ? config.get_white() : config.get_black()).get_king_square();
+    std::array<const int16_t *, 32> added;
+    size_t n = 0;
+    for (const bool is_white : {false, true}) {
+      const auto &own = is_white ? config.get_white() : config.get_black();
+      for (const auto p : {piece::pawn, piece::rook, piece::knight, piece::bishop, piece::queen}) {
+        for (auto bb = own.get_bitboard(p); bb; bb &= bb - 1) {
+          added[n++] = row(feature(perspective, king, is_white, p, std::countr_zero(bb)));
+        }
+      }
+    }
+    kernels->update(acc.values[perspective].data(), ft_bias, std::span(added).first(n), {});
+  }
+
+  void refresh(accumulator &acc, const configuration &config) const noexcept {
+    refresh(acc, config, false);
+    refresh(acc, config, true);
+  }
+
+  /**
+   * Derives the accumulator of `after` from that of `before`, where `after` is `before.play(m)`.
+   * Only the pieces `m` moves are updated, except that a king move changes every feature of
+   * its own color, which is refreshed instead.
+   */
+  void update(const accumulator &parent, accumulator &child, const configuration &before,
+              const move m, const configuration &after) const noexcept {
+    struct change {
+      bool is_white;
+      piece p;
+      square s;
+    };
+    std::array<change, 2> added;
+    std::array<change, 3> removed;
+    size_t n_added = 0, n_removed = 0;
+    const bool is_white = before.is_white_turn();
+    const auto &us = is_white ? before.get_white() : before.get_black();
+    const auto &them = is_white ? before.get_black() : before.get_white();
+    const auto src = m.get_src_square(), dst = m.get_dst_square();
+    const auto p = us.get(src);
+    if (p != piece::king) {
+      removed[n_removed++] = {is_white, p, src};
+      const auto placed = m.get_promotion() == piece::empty ? p : m.get_promotion();
+      added[n_added++] = {is_white, placed, dst};
+    } else if (m.dst() == m.src() << 2 || m.src() == m.dst() << 2) {
+      const bool kingside = dst < src;
+      const square from = kingside ? src - 3 : src + 4, to = kingside ? src - 1 : src + 1;
+      removed[n_removed++] = {is_white, piece::rook, from};
+      added[n_added++] = {is_white, piece::rook, to};
+    }
+    if (m.dst(them)) {
+      removed[n_removed++] = {!is_white, them.get(dst), dst};
+    } else if (p == piece::pawn && m.dst(before.get_en_passant())) {
+      const square captured = is_white ? dst - 8 : dst + 8;
+      removed[n_removed++] = {!is_white, piece::pawn, captured};
+    }
+
+    for (const bool perspective : {false, true}) {
+      if (p == piece::king && perspective == is_white) {
+        refresh(child, after, perspective);
+        continue;
+      }
+      const auto king = (perspective ? after.get_white() : after.get_black()).get_king_square();
+      std::array<const int16_t *, 2> add;
+      std::array<const int16_t *, 3> remove;
+      for (size_t i = 0; i < n_added; ++i) {
+        const auto &c = added[i];
+        add[i] = row(feature(perspective, king, c.is_white, c.p, c.s));
+      }
+      for (size_t i = 0; i < n_removed; ++i) {
+        const auto &c = removed[i];
+        remove[i] = row(feature(perspective, king, c.is_white, c.p, c.s));
+      }
+      kernels->update(child.values[perspective].data(), parent.values[perspective].data(),
+                      std::span(add).first(n_added), std::span(remove).first(n_removed));
+    }
+  }
+
+  /** The score in centipawns for the side to move, `white_turn`. */
+  [[nodiscard]] int evaluate(const accumulator &acc, const bool white_turn) const noexcept {
+    alignas(64) std::array<int16_t, 2 * width> input;
+    for (size_t i = 0; i < width; ++i) {
+      input[i] = std::clamp<int16_t>(acc.values[white_turn][i], 0, 127);
+      input[width + i] = std::clamp<int16_t>(acc.values[!white_turn][i], 0, 127);
+    }
+    std::array<int32_t, hidden> sums;
+    kernels->dense(sums.data(), input.data(), l1_weights, l1_bias);
+    auto output = *out_bias;
+    for (size_t j = 0; j < hidden; ++j) {
+      output += out_weights[j] * std::clamp(sums[j] >> 6, 0, 127);
+    }
+    return output / 16;
+  }
+
+  /** Writes a network of the given weights to `path`; whether it could. */
+  [[nodiscard]] static bool save(const char *const path, const std::span<const int16_t> ft_weights,
+                                 const std::span<const int16_t> ft_bias,
+                                 const std::span<const int8_t> l1_weights,
+                                 const std::span<const int32_t> l1_bias,
+                                 const std::span<const int8_t> out_weights,
+                                 const int32_t out_bias) noexcept {
+    assert(ft_weights.size() == features * width && ft_bias.size() == width &&
+           l1_weights.size() == hidden * 2 * width && l1_bias.size() == hidden &&
+           out_weights.size() == hidden);
+    std::FILE *const file = std::fopen(path, "wb");
+    if (!file) {
+      std::perror(path);
+      return false;
+    }
+    std::array<char, impl::header> header{};
+    std::ranges::copy(impl::magic, header.begin());
+    const auto write = [file](const auto data) {
+      return std::fwrite(data.data(), sizeof(data[0]), data.size(), file) == data.size();
+    };
+    const bool written = write(std::span(header)) && write(ft_weights) && write(ft_bias) &&
+                         write(l1_weights) && write(l1_bias) && write(out_weights) &&
+                         write(std::span(&out_bias, 1));
+    if (std::fclose(file) != 0 || !written) {
+      std::perror(path);
+      return false;
+    }
+    return true;
+  }
+};
+
+} // namespace nnue
@@ -0,0 +1,114 @@
+// https://www.chessprogramming.org/Perft_Results
+#include "arguments.hpp"
+#include "chess.hpp"
+#include "fen.hpp"
+#include "perft.hpp"
+#include "uci.hpp"
+#include <chrono>
+#include <cstring>
+#include <iostream>
+#include <unistd.h>
+
+void report(const uint64_t nodes, const std::chrono::duration<double> elapsed) {
+  std::cout << elapsed.count() << " s, "
+            << static_cast<uint64_t>(nodes / std::max(elapsed.count(), 1e-9)) << " nps";
+}
+
+// perft [-t threads] [-H hash-megabytes] [-s] [max-depth] [divide]
+//   -s  also time the deepest depth of each position on 1, 2, 4, ... threads.
+int main(const int argc, char *const argv[]) {
+  std::cin.tie(nullptr)->sync_with_stdio(false);
+  unsigned threads = std::max(std::thread::hardware_concurrency(), 1U);
+  size_t hash_megabytes = 0;
+  bool scaling = false;
+  int max_depth = 5;
+  bool usage = false;
+  for (int opt; (opt = getopt(argc, argv, "t:H:s")) != -1;) {
+    switch (opt) {
+    case 't':
+      usage |= !parse(optarg, threads) || threads == 0;
+      break;
+    case 'H':
+      usage |= !parse(optarg, hash_megabytes);
+      break;
+    case 's':
+      scaling = true;
+      break;
+    default:
+      usage = true;
+    }
+  }
+  if (optind < argc) {
+    usage |= !parse(argv[optind++], max_depth) || max_depth < 1;
+  }
+  const bool divide = optind < argc && std::string_view(argv[optind]) == "divide";
+  if (usage) {
+    std::cerr << "usage: " << argv[0]
+              << " [-t threads] [-H hash-megabytes] [-s] [max-depth] [divide]\n";
+    return 2;
+  }
+
+  std::optional<perft_cache> cache;
+  if (hash_megabytes != 0) {
+    cache.emplace(hash_megabytes);
+  }
+  const auto count = [&cache](const configuration &config, const int depth, const unsigned n) {
+    if (cache) {
+      cache->clear(); // Every run starts cold, so that timings compare.
+    }
+    return parallel_perft(config, depth, n, cache ? &*cache : nullptr);
+  };
+
+  bool passed = true;
+  for (const auto &[name, fen, expected] : references) {
+    const auto config = parse_fen(fen);
+    assert(config);
+    std::cout << name << ": " << fen << '\n';
+    const auto deepest = std::min<int>(max_depth, std::ranges::count_if(expected, std::identity{}));
+    for (int depth = 1; depth <= deepest; ++depth) {
+      const auto start = std::chrono::steady_clock::now();
+      const auto moves = count(*config, depth, threads);
+      const std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+      uint64_t nodes = 0;
+      for (const auto [m, n] : moves) {
+        if (divide && depth == deepest) {
+          std::cout << "  " << m << ": " << n << '\n';
+        }
+        nodes += n;
+      }
+      std::cout << "  depth " << depth << ": " << nodes;
+      if (nodes == expected[depth - 1]) {
+        std::cout << " ok";
+      } else {
+        std::cout << " FAIL, expected " << expected[depth - 1];
+        passed = false;
+      }
+      std::cout << ", ";
+      report(nodes, elapsed);
+      std::cout << '\n';
+    }
+    if (scaling) {
+      std::chrono::duration<double> single{};
+      for (unsigned n = 1;; n = std::min(n * 2, threads)) {
+        const auto start = std::chrono::steady_clock::now();
+        uint64_t nodes = 0;
+        for (const auto [m, subtree] : count(*config, deepest, n)) {
+          nodes += subtree;
+        }
+        const std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+        if (n == 1) {
+          single = elapsed;
+        }
+        const auto speedup = single / elapsed;
+        std::cout << "  " << n << " threads: ";
+        report(nodes, elapsed);
+        std::cout << ", speedup " << speedup << ", efficiency " << speedup / n << '\n';
+        if (n == threads) {
+          break;
+        }
+      }
+    }
+  }
+  std::cout << std::flush;
+  return passed ? 0 : 1;
+}
@@ -0,0 +1,249 @@
+// https://www.chessprogramming.org/Perft
+#pragma once
+#include "chess.hpp"
+#include "fen.hpp"
+#include <atomic>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <thread>
+#include <vector>
+
+/** A well-known position with its published perft results. */
+struct reference {
+  const char *name, *fen;
+  std::array<uint64_t, 8> nodes; // By depth, starting at 1; zero where unknown.
+};
+
+constexpr std::array references{
+    reference{
+        "startpos",
+        "rnbqkbnr/pppppppp/8/8/8/8/PPPPPPPP/RNBQKBNR w KQkq - 0 1",
+        {20, 400, 8'902, 197'281, 4'865'609, 119'060'324, 3'195'901'860},
+    },
+    reference{
+        "kiwipete",
+        "r3k2r/p1ppqpb1/bn2pnp1/3PN3/1p2P3/2N2Q1p/PPPBBPPP/R3K2R w KQkq - 0 1",
+        {48, 2'039, 97'862, 4'085'603, 193'690'690, 8'031'647'685},
+    },
+    reference{
+        "position 3",
+        "8/2p5/3p4/KP5r/1R3p1k/8/4P1P1/8 w - - 0 1",
+        {14, 191, 2'812, 43'238, 674'624, 11'030'083, 178'633'661, 3'009'794'393},
+    },
+    reference{
+        "position 4",
+        "r3k2r/Pppp1ppp/1b3nbN/nP6/BBP1P3/q4N2/Pp1P2PP/R2Q1RK1 w kq - 0 1",
+        {6, 264, 9'467, 422'333, 15'833'292, 706'045'033},
+    },
+    reference{
+        "position 4 mirrored",
+        "r2q1rk1/pP1p2pp/Q4n2/bbp1p3/Np6/1B3NBn/pPPP1PPP/R3K2R b KQ - 0 1",
+        {6, 264, 9'467, 422'333, 15'833'292, 706'045'033},
+    },
+    reference{
+        "position 5",
+        "rnbq1k1r/pp1Pbppp/2p5/8/2B5/8/PPP1NnPP/RNBQK2R w KQ - 1 8",
+        {44, 1'486, 62'379, 2'103'487, 89'941'194},
+    },
+    reference{
+        "position 6",
+        "r4rk1/1pp1qppp/p1np1n2/2b1p1B1/2B1P1b1/P1NP1N2/1PP1QPPP/R4RK1 w - - 0 10",
+        {46, 2'079, 89'890, 3'894'594, 164'075'551, 6'923'051'137},
+    },
+};
+
+/** A benchmark corpus: every position up to 2 plies away from the reference positions. */
+template <class Side> std::vector<basic_configuration<Side>> corpus() {
+  std::vector<basic_configuration<Side>> positions;
+  for (const auto &r : references) {
+    const auto root = *parse_fen<Side>(r.fen);
+    positions.push_back(root);
+    for (const auto m : root.generate_legal_moves()) {
+      const auto child = root.play(m);
+      positions.push_back(child);
+      for (const auto n : child.generate_legal_moves()) {
+        positions.push_back(child.play(n));
+      }
+    }
+  }
+  return positions;
+}
+
+/**
+ * Shared (key, depth) -> node count table. Entries are two words written without locks; the first
+ * holds key ^ data, so a torn entry written by racing threads fails verification instead of
+ * returning a wrong count. Each bucket keeps the deepest result seen plus the most recent one.
+ */
+class perft_cache {
+  struct entry {
+    std::atomic<uint64_t> check, data; // data: node count << 8 | depth
+  };
+  struct bucket {
+    entry deepest, recent;
+  };
+
+  std::unique_ptr<bucket[]> buckets;
+  size_t mask;
+
+public:
+  explicit perft_cache(const size_t megabytes)
+      : mask(std::bit_floor(std::max<size_t>(megabytes * 1024 * 1024 / sizeof(bucket), 1)) - 1) {
+    buckets = std::make_unique<bucket[]>(mask + 1);
+  }
+
+  void clear() noexcept {
+    for (size_t i = 0; i <= mask; ++i) {
+      for (auto *e : {&buckets[i].deepest, &buckets[i].recent}) {
+        e->check.store(0, std::memory_order_relaxed);
+        e->data.store(0, std::memory_order_relaxed);
+      }
+    }
+  }
+
+  [[nodiscard]] std::optional<uint64_t> probe(const uint64_t key, const int depth) const noexcept {
+    auto &b = buckets[key & mask];
+    for (const auto *e : {&b.deepest, &b.recent}) {
+      const auto data = e->data.load(std::memory_order_relaxed);
+      const auto check = e->check.load(std::memory_order_relaxed);
+      if ((check ^ data) == key && static_cast<int>(data & 0xFF) == depth) {
+        return data >> 8;
+      }
+    }
+    return std::nullopt;
+  }
+
+  void store(const uint64_t key, const int depth, const uint64_t nodes) noexcept {
+    auto &b = buckets[key & mask];
+    const auto data = nodes << 8 | static_cast<uint64_t>(depth);
+    const auto deepest = static_cast<int>(b.deepest.data.load(std::memory_order_relaxed) & 0xFF);
+    auto &e = depth >= deepest ? b.deepest : b.recent;
+    e.check.store(key ^ data, std::memory_order_relaxed);
+    e.data.store(data, std::memory_order_relaxed);
+  }
+};
+
+/** Number of leaves of the legal move tree; the last ply is counted without being played. */
+inline uint64_t perft(configuration &config, const int depth, ply_stack &plies,
+                      perft_cache *const cache) {
+  const auto moves = config.generate_legal_moves();
+  if (depth <= 1) {
+    return depth == 1 ? moves.size() : 1;
+  }
+  const auto key = config.get_key();
+  if (cache) {
+    if (const auto nodes = cache->probe(key, depth)) {
+      return *nodes;
+    }
+  }
+  uint64_t nodes = 0;
+  for (const auto m : moves) {
+    config.make_move(m, plies);
+    nodes += perft(config, depth - 1, plies, cache);
+    config.unmake_move(plies);
+  }
+  if (cache) {
+    cache->store(key, depth, nodes);
+  }
+  return nodes;
+}
+
+namespace impl {
+
+struct perft_task {
+  configuration config;
+  int depth;
+  size_t root; // Index of the root move whose subtree this is.
+};
+
+/** The owner works at the back of its deque, depth first; thieves take from the front. */
+class perft_deque {
+  std::mutex mutex;
+  std::deque<perft_task> tasks;
+
+public:
+  void push(const perft_task &task) {
+    const std::lock_guard lock(mutex);
+    tasks.push_back(task);
+  }
+
+  std::optional<perft_task> pop() {
+    const std::lock_guard lock(mutex);
+    if (tasks.empty()) {
+      return std::nullopt;
+    }
+    const auto task = tasks.back();
+    tasks.pop_back();
+    return task;
+  }
+
+  std::optional<perft_task> steal() {
+    const std::lock_guard lock(mutex);
+    if (tasks.empty()) {
+      return std::nullopt;
+    }
+    const auto task = tasks.front();
+    tasks.pop_front();
+    return task;
+  }
+};
+
+} // namespace impl
+
+/**
+ * Perft divide over `threads` workers with work stealing. Subtrees deeper than `split_depth` are
+ * expanded into the worker's own deque, where idle workers steal them from the shallow end; the
+ * rest are counted sequentially. Returns the node count below each root move, in generation order.
+ */
+inline std::vector<std::pair<move, uint64_t>>
+parallel_perft(const configuration &config, const int depth, const unsigned threads,
+               perft_cache *const cache, const int split_depth = 3) {
+  assert(depth >= 1 && threads >= 1);
+  const auto moves = config.generate_legal_moves();
+  std::vector<std::atomic<uint64_t>> counts(moves.size());
+  std::vector<impl::perft_deque> deques(threads);
+  std::atomic<size_t> pending = moves.size();
+  for (size_t i = 0; i < moves.size(); ++i) {
+    deques[i % threads].push({config.play(moves[i]), depth - 1, i});
+  }
+
+  const auto work = [&](const unsigned self) {
+    ply_stack plies;
+    while (pending.load(std::memory_order_acquire) != 0) {
+      auto task = deques[self].pop();
+      for (unsigned k = 1; !task && k < threads; ++k) {
+        task = deques[(self + k) % threads].steal();
+      }
+      if (!task) {
+        std::this_thread::yield();
+        continue;
+      }
+      if (task->depth > split_depth) {
+        const auto children = task->config.generate_legal_moves();
+        pending.fetch_add(children.size(), std::memory_order_relaxed);
+        for (const auto m : children) {
+          deques[self].push({task->config.play(m), task->depth - 1, task->root});
+        }
+      } else {
+        counts[task->root].fetch_add(perft(task->config, task->depth, plies, cache),
+                                     std::memory_order_relaxed);
+      }
+      pending.fetch_sub(1, std::memory_order_acq_rel);
+    }
+  };
+  std::vector<std::thread> workers;
+  for (unsigned self = 1; self < threads; ++self) {
+    workers.emplace_back(work, self);
+  }
+  work(0);
+  for (auto &worker : workers) {
+    worker.join();
+  }
+
+  std::vector<std::pair<move, uint64_t>> divide;
+  for (size_t i = 0; i < moves.size(); ++i) {
+    divide.emplace_back(moves[i], counts[i].load(std::memory_order_relaxed));
+  }
+  return divide;
+}
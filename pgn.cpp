@@ -0,0 +1,81 @@
+// Imports the games of a PGN file on several threads, optionally into a position file.
+#include "arguments.hpp"
+#include "chess.hpp"
+#include "pgn.hpp"
+#include "positions.hpp"
+#include <chrono>
+#include <iostream>
+#include <unistd.h>
+#include <vector>
+
+/** Every position of the game, the last one included, labelled with its outcome. */
+void write_positions(batched_writer &out, const unsigned self, const pgn_game &game) {
+  auto config = game.start;
+  auto counters = game.counters;
+  for (const auto m : game.moves) {
+    out.write(self, packed_position::pack(config, counters, packed_position::no_score,
+                                          game.result));
+    counters.advance(config, m);
+    config = config.play(m);
+  }
+  out.write(self, packed_position::pack(config, counters, packed_position::no_score, game.result));
+}
+
+// pgn [-j threads] [-o positions] file
+//   -o  write every position of every game, with the game's outcome, to a position file; the
+//       games of different threads interleave.
+int main(const int argc, char *const argv[]) {
+  std::cin.tie(nullptr)->sync_with_stdio(false);
+  unsigned threads = std::max(std::thread::hardware_concurrency(), 1U);
+  const char *output = nullptr;
+  bool usage = false;
+  for (int opt; (opt = getopt(argc, argv, "j:o:")) != -1;) {
+    switch (opt) {
+    case 'j':
+      usage |= !parse(optarg, threads) || threads == 0;
+      break;
+    case 'o':
+      output = optarg;
+      break;
+    default:
+      usage = true;
+    }
+  }
+  if (usage || optind + 1 != argc) {
+    std::cerr << "usage: " << argv[0] << " [-j threads] [-o positions] file\n";
+    return 2;
+  }
+  const auto file = pgn_file::open(argv[optind]);
+  if (!file) {
+    return 1;
+  }
+  auto writer = output ? position_writer::create(output) : std::nullopt;
+  if (output && !writer) {
+    return 1;
+  }
+
+  const auto start = std::chrono::steady_clock::now();
+  pgn_stats stats;
+  bool ok = true;
+  if (writer) {
+    batched_writer out(*writer, threads);
+    stats = parallel_import(file->text(), threads, [&out](const unsigned self, const auto &game) {
+      write_positions(out, self, game);
+    });
+    ok = out.finish() && writer->close();
+    if (!ok) {
+      std::perror(output);
+    }
+  } else {
+    stats = parallel_import(file->text(), threads, [](unsigned, const auto &) {});
+  }
+  const std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+
+  const auto seconds = std::max(elapsed.count(), 1e-9);
+  std::cout << stats.games << " games, " << stats.moves << " moves, " << stats.rejected
+            << " rejected in " << elapsed.count() << " s on " << threads << " threads: "
+            << static_cast<uint64_t>(stats.games / seconds) << " games/s, "
+            << static_cast<uint64_t>(stats.moves / seconds) << " moves/s, "
+            << file->text().size() / seconds / 1e6 << " MB/s" << std::endl;
+  return ok ? 0 : 1;
+}
@@ -0,0 +1,394 @@
+// https://www.chessprogramming.org/Portable_Game_Notation
+// https://www.chessprogramming.org/Algebraic_Chess_Notation#Standard_Algebraic_Notation_.28SAN.29
+#pragma once
+#include "chess.hpp"
+#include "fen.hpp"
+#include "mapped_file.hpp"
+#include "positions.hpp"
+#include <algorithm>
+#include <optional>
+#include <span>
+#include <string_view>
+#include <sys/mman.h>
+#include <thread>
+#include <utility>
+#include <vector>
+
+/**
+ * The legal move `san` stands for in `config`, in Standard Algebraic Notation with or without
+ * its check and annotation suffixes; nothing if it names no legal move or more than one. Castling
+ * may be written with zeros, and a promotion without its `=`.
+ */
+template <class Side>
+[[nodiscard]] constexpr std::optional<move> parse_san(const basic_configuration<Side> &config,
+                                                      std::string_view san) noexcept {
+  while (!san.empty() && std::string_view("+#!?").contains(san.back())) {
+    san.remove_suffix(1);
+  }
+  const bool is_white = config.is_white_turn();
+  const auto &us = is_white ? config.get_white() : config.get_black();
+  if (san == "O-O" || san == "0-0" || san == "O-O-O" || san == "0-0-0") {
+    const square king = us.get_king_square();
+    if (king != (is_white ? 3 : 59)) {
+      return std::nullopt;
+    }
+    const move m(king, san.size() == 3 ? king - 2 : king + 2);
+    return config.is_legal(m) ? std::optional(m) : std::nullopt;
+  }
+
+  constexpr std::string_view letters = ".PRNBQK"; // Indexed by piece.
+  const auto piece_of = [letters](const char c) {
+    const auto i = letters.find(c);
+    return i == letters.npos || i == 0 ? piece::empty : static_cast<piece>(i);
+  };
+  auto promotion = piece::empty;
+  if (!san.empty() && (promotion = piece_of(san.back())) != piece::empty) {
+    san.remove_suffix(1);
+    if (!san.empty() && san.back() == '=') {
+      san.remove_suffix(1);
+    }
+  }
+  auto p = san.empty() ? piece::empty : piece_of(san.front());
+  if (p == piece::empty) {
+    p = piece::pawn;
+  } else {
+    san.remove_prefix(1);
+  }
+  if (san.size() < 2) {
+    return std::nullopt;
+  }
+  const auto file = san[san.size() - 2], rank = san[san.size() - 1];
+  if (file < 'a' || file > 'h' || rank < '1' || rank > '8') {
+    return std::nullopt;
+  }
+  const square dst = 'h' - file + 8 * (rank - '1');
+  san.remove_suffix(2);
+
+  // What comes between the piece and its destination narrows down where it comes from.
+  auto from = us.get_bitboard(p);
+  bool capture = false;
+  for (const char c : san) {
+    if (c >= 'a' && c <= 'h') {
+      from &= uint64_t{0x0101'0101'0101'0101} << ('h' - c);
+    } else if (c >= '1' && c <= '8') {
+      from &= uint64_t{0xFF} << 8 * (c - '1');
+    } else if (c == 'x') {
+      capture = true;
+    } else {
+      return std::nullopt;
+    }
+  }
+  const auto occupied = config.get_white().get_occupancy() | config.get_black().get_occupancy();
+  const auto target = uint64_t{1} << dst;
+  switch (p) {
+  case piece::pawn:
+    if (capture || !san.empty()) {
+      from &= attacks::pawn(dst, !is_white);
+    } else {
+      const auto one = is_white ? target >> 8 : target << 8;
+      from &= one & occupied ? one : one | (is_white ? target >> 16 : target << 16);
+    }
+    if ((dst / 8 == (is_white ? 7 : 0)) != (promotion != piece::empty)) {
+      return std::nullopt;
+    }
+    break;
+  case piece::rook:
+    from &= attacks::rook(dst, occupied);
+    break;
+  case piece::knight:
+    from &= attacks::knight(dst);
+    break;
+  case piece::bishop:
+    from &= attacks::bishop(dst, occupied);
+    break;
+  case piece::queen:
+    from &= attacks::queen(dst, occupied);
+    break;
+  case piece::king:
+    from &= attacks::king(dst);
+    break;
+  case piece::empty:
+    std::unreachable();
+  }
+  if (p != piece::pawn && promotion != piece::empty) {
+    return std::nullopt;
+  }
+
+  std::optional<move> found;
+  for (; from; from &= from - 1) {
+    const move m(std::countr_zero(from), dst, promotion);
+    if (config.is_legal(m)) {
+      if (found) {
+        return std::nullopt; // Ambiguous.
+      }
+      found = m;
+    }
+  }
+  return found;
+}
+
+static_assert(parse_san(configuration(), "e4") == move(11, 27));
+static_assert(parse_san(configuration(), "Nf3+") == move(1, 18));
+static_assert(!parse_san(configuration(), "O-O"));
+static_assert(!parse_san(configuration(), "e5"));
+
+/** A game as a reader decoded it; the moves are valid until the reader reads the next game. */
+struct pgn_game {
+  configuration start;
+  fen_counters counters; // Of the starting position.
+  std::span<const move> moves;
+  outcome result;
+};
+
+/** What a reader has gone through. */
+struct pgn_stats {
+  size_t games = 0, moves = 0, rejected = 0;
+
+  constexpr pgn_stats &operator+=(const pgn_stats &other) noexcept {
+    games += other.games;
+    moves += other.moves;
+    rejected += other.rejected;
+    return *this;
+  }
+};
+
+namespace impl {
+
+[[nodiscard]] constexpr bool is_pgn_space(const char c) noexcept {
+  return c == ' ' || c == '\n' || c == '\r' || c == '\t';
+}
+
+/** Whether `c` ends a movetext token. */
+[[nodiscard]] constexpr bool is_pgn_delimiter(const char c) noexcept {
+  return is_pgn_space(c) || std::string_view("{}();[$").contains(c);
+}
+
+[[nodiscard]] constexpr outcome pgn_outcome(const std::string_view token) noexcept {
+  return token == "1-0"       ? outcome::white_wins
+         : token == "0-1"     ? outcome::black_wins
+         : token == "1/2-1/2" ? outcome::draw
+                              : outcome::unknown;
+}
+
+} // namespace impl
+
+/**
+ * Reads the games of PGN text one after another. Tags other than FEN and Result are skipped, as
+ * are comments, variations and numeric annotation glyphs. A game with a move that cannot be
+ * decoded is counted as rejected and skipped. Moves go into a buffer that is reused from game to
+ * game, so nothing is allocated once it has grown to the longest game.
+ */
+class pgn_reader {
+  std::string_view text;
+  size_t pos = 0;
+  std::vector<move> moves;
+  pgn_stats stats;
+
+  constexpr void skip_space() noexcept {
+    while (pos < text.size() && impl::is_pgn_space(text[pos])) {
+      ++pos;
+    }
+  }
+
+  constexpr void skip_past(const char c) noexcept {
+    pos = std::min(text.find(c, pos), text.size() - 1) + 1;
+  }
+
+  /** Skips a variation, which may nest and hold comments, from its opening parenthesis. */
+  constexpr void skip_variation() noexcept {
+    for (int depth = 0; pos < text.size();) {
+      switch (text[pos++]) {
+      case '(':
+        ++depth;
+        break;
+      case ')':
+        if (--depth == 0) {
+          return;
+        }
+        break;
+      case '{':
+        skip_past('}');
+        break;
+      case ';':
+        skip_past('\n');
+        break;
+      }
+    }
+  }
+
+  /** The name and value of a tag pair such as `[FEN "..."]`, from its bracket; escapes stay. */
+  constexpr std::pair<std::string_view, std::string_view> read_tag() noexcept {
+    const auto start = ++pos;
+    while (pos < text.size() && !impl::is_pgn_space(text[pos]) && text[pos] != '"') {
+      ++pos;
+    }
+    const auto name = text.substr(start, pos - start);
+    std::string_view value;
+    if (const auto quote = text.find('"', pos); quote != text.npos) {
+      auto close = quote + 1;
+      while (close < text.size() && text[close] != '"' && text[close] != '\n') {
+        close += text[close] == '\\' ? 2 : 1;
+      }
+      value = text.substr(quote + 1, std::min(close, text.size()) - quote - 1);
+      pos = std::min(close, text.size());
+    }
+    skip_past(']');
+    return {name, value};
+  }
+
+public:
+  explicit constexpr pgn_reader(const std::string_view text) noexcept : text(text) {}
+
+  /** The next game; nothing once the text runs out. */
+  std::optional<pgn_game> next() noexcept {
+    for (;;) {
+      skip_space();
+      if (pos >= text.size()) {
+        return std::nullopt;
+      }
+      pgn_game game{configuration(), {}, {}, outcome::unknown};
+      bool ok = true;
+      while (pos < text.size() && text[pos] == '[') {
+        const auto [name, value] = read_tag();
+        if (name == "FEN") {
+          const auto config = parse_fen(value, game.counters);
+          ok &= config.has_value();
+          game.start = config.value_or(configuration());
+        } else if (name == "Result") {
+          game.result = impl::pgn_outcome(value);
+        }
+        skip_space();
+      }
+
+      moves.clear();
+      auto config = game.start;
+      while (pos < text.size()) {
+        const char c = text[pos];
+        if (impl::is_pgn_space(c)) {
+          ++pos;
+        } else if (c == '{') {
+          skip_past('}');
+        } else if (c == ';') {
+          skip_past('\n');
+        } else if (c == '(') {
+          skip_variation();
+        } else if (c == '[') {
+          break; // The next game, this one having no result.
+        } else if (c == '*') {
+          ++pos;
+          game.result = outcome::unknown;
+          break;
+        } else {
+          const auto start = pos++;
+          while (pos < text.size() && !impl::is_pgn_delimiter(text[pos])) {
+            ++pos;
+          }
+          auto token = text.substr(start, pos - start);
+          if (c == '$' || c == ')') {
+            continue; // A numeric annotation glyph, or a stray parenthesis.
+          }
+          if (const auto result = impl::pgn_outcome(token); result != outcome::unknown) {
+            game.result = result;
+            break;
+          }
+          // A move number, perhaps with the move written right after its periods.
+          if (const auto digits = token.find_first_not_of("0123456789"); digits == token.npos) {
+            token = {};
+          } else if (digits != 0 && token[digits] == '.') {
+            token.remove_prefix(std::min(token.find_first_not_of('.', digits), token.size()));
+          }
+          if (!ok || token.empty()) {
+            continue;
+          }
+          if (const auto m = parse_san(config, token)) {
+            moves.push_back(*m);
+            config = config.play(*m);
+          } else {
+            ok = false;
+          }
+        }
+      }
+      if (ok) {
+        game.moves = moves;
+        ++stats.games;
+        stats.moves += moves.size();
+        return game;
+      }
+      ++stats.rejected;
+    }
+  }
+
+  [[nodiscard]] constexpr const pgn_stats &get_stats() const noexcept { return stats; }
+};
+
+/**
+ * Where the games of `text` split into `parts` pieces of about equal size: each boundary is moved
+ * forward to the start of a tag section, a line opening with `[` after one that does not. A
+ * comment with such a line in it would be cut in two.
+ */
+[[nodiscard]] inline std::vector<size_t> split_pgn(const std::string_view text,
+                                                   const size_t parts) {
+  std::vector<size_t> bounds{0};
+  for (size_t i = 1; i < parts; ++i) {
+    auto pos = std::max(bounds.back(), text.size() * i / parts);
+    for (; (pos = text.find("\n[", pos)) != text.npos; ++pos) {
+      const auto line = pos ? text.rfind('\n', pos - 1) : text.npos;
+      if (text[line == text.npos ? 0 : line + 1] != '[') {
+        break;
+      }
+    }
+    bounds.push_back(pos == text.npos ? text.size() : pos + 1);
+  }
+  bounds.push_back(text.size());
+  return bounds;
+}
+
+/**
+ * Reads the games of `text` on `threads` workers, each taking one piece of `split_pgn`, and calls
+ * `f(worker, game)` for each game decoded; calls from different workers may be concurrent.
+ */
+inline pgn_stats parallel_import(const std::string_view text, const unsigned threads, auto &&f) {
+  assert(threads >= 1);
+  const auto bounds = split_pgn(text, threads);
+  std::vector<pgn_stats> stats(threads);
+  const auto work = [&](const unsigned self) {
+    pgn_reader reader(text.substr(bounds[self], bounds[self + 1] - bounds[self]));
+    while (const auto game = reader.next()) {
+      f(self, *game);
+    }
+    stats[self] = reader.get_stats();
+  };
+  std::vector<std::thread> workers;
+  for (unsigned self = 1; self < threads; ++self) {
+    workers.emplace_back(work, self);
+  }
+  work(0);
+  for (auto &worker : workers) {
+    worker.join();
+  }
+  pgn_stats total;
+  for (const auto &s : stats) {
+    total += s;
+  }
+  return total;
+}
+
+/** A PGN file mapped read-only, however large; the kernel pages it in as the workers read. */
+class pgn_file {
+  mapped_file file;
+
+  explicit pgn_file(mapped_file &&file) noexcept : file(std::move(file)) {}
+
+public:
+  /** Maps the file at `path`; nothing if it cannot. */
+  [[nodiscard]] static std::optional<pgn_file> open(const char *const path) noexcept {
+    auto file = mapped_file::open(path);
+    if (!file) {
+      return std::nullopt;
+    }
+    file->advise(MADV_SEQUENTIAL);
+    return pgn_file(std::move(*file));
+  }
+
+  [[nodiscard]] std::string_view text() const noexcept { return {file.at<char>(0), file.size()}; }
+};
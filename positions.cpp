@@ -0,0 +1,152 @@
+// Converts between FEN or EPD text and position files, and times reading them back.
+#include "chess.hpp"
+#include "fen.hpp"
+#include "positions.hpp"
+#include <charconv>
+#include <chrono>
+#include <iostream>
+#include <string>
+#include <unistd.h>
+
+/** The score and outcome of an EPD record: `ce` in centipawns, and `c9` as labelled sets have. */
+void annotate(const epd_record<> &record, int16_t &score, outcome &result) {
+  if (const auto ce = record.find("ce")) {
+    int value;
+    const auto [ptr, ec] = std::from_chars(ce->data(), ce->data() + ce->size(), value);
+    if (ec == std::errc{} && ptr == ce->data() + ce->size() && std::abs(value) <= 32'767) {
+      score = static_cast<int16_t>(value);
+    }
+  }
+  if (auto c9 = record.find("c9")) {
+    if (c9->size() >= 2 && c9->front() == '"' && c9->back() == '"') {
+      *c9 = c9->substr(1, c9->size() - 2);
+    }
+    result = *c9 == "1-0"       ? outcome::white_wins
+             : *c9 == "0-1"     ? outcome::black_wins
+             : *c9 == "1/2-1/2" ? outcome::draw
+                                : outcome::unknown;
+  }
+}
+
+int pack(const char *const path) {
+  auto writer = position_writer::create(path);
+  if (!writer) {
+    return 1;
+  }
+  size_t lines = 0, packed = 0, text_bytes = 0;
+  for (std::string line; std::getline(std::cin, line); ++lines) {
+    text_bytes += line.size() + 1;
+    fen_counters counters;
+    int16_t score = packed_position::no_score;
+    auto result = outcome::unknown;
+    auto config = parse_fen(line, counters);
+    if (!config) {
+      const auto record = parse_epd(line);
+      if (!record) {
+        std::cerr << path << ": line " << lines + 1 << " is neither FEN nor EPD\n";
+        continue;
+      }
+      config = record->config;
+      annotate(*record, score, result);
+    }
+    if (!writer->write(packed_position::pack(*config, counters, score, result))) {
+      break;
+    }
+    ++packed;
+  }
+  if (!writer->close()) {
+    std::perror(path);
+    return 1;
+  }
+  std::cout << packed << " of " << lines << " lines packed, " << text_bytes << " bytes of text, "
+            << sizeof(impl::position_file_header) + packed * sizeof(packed_position)
+            << " bytes packed" << std::endl;
+  return packed == lines ? 0 : 1;
+}
+
+int print(const position_store &store) {
+  std::array<char, max_fen_length + 1> buffer;
+  for (size_t i = 0; i < store.size(); ++i) {
+    fen_counters counters;
+    const auto config = store[i].unpack(counters);
+    if (!config) {
+      std::cerr << "record " << i << " holds no position\n";
+      return 1;
+    }
+    auto end = write_fen(*config, buffer.data(), counters);
+    *end++ = '\n';
+    std::cout.write(buffer.data(), end - buffer.data());
+  }
+  std::cout << std::flush;
+  return 0;
+}
+
+/** Reading every record, against parsing the same positions from FEN. */
+int benchmark(const position_store &store) {
+  store.advise_sequential();
+  uint64_t checksum = 0;
+  auto start = std::chrono::steady_clock::now();
+  for (const auto &record : store) {
+    if (const auto config = record.unpack()) {
+      checksum += config->get_key();
+    }
+  }
+  const std::chrono::duration<double> unpacking = std::chrono::steady_clock::now() - start;
+
+  std::string text;
+  std::array<char, max_fen_length> buffer;
+  for (const auto &record : store) {
+    fen_counters counters;
+    if (const auto config = record.unpack(counters)) {
+      text.append(buffer.data(), write_fen(*config, buffer.data(), counters)).push_back('\n');
+    }
+  }
+  start = std::chrono::steady_clock::now();
+  for (size_t first = 0, last; first < text.size(); first = last + 1) {
+    last = text.find('\n', first);
+    checksum += parse_fen(std::string_view(text).substr(first, last - first))->get_key();
+  }
+  const std::chrono::duration<double> parsing = std::chrono::steady_clock::now() - start;
+
+  const auto n = static_cast<double>(store.size());
+  std::cout << store.size() << " records: unpacked " << n / unpacking.count()
+            << " per second from " << store.size() * sizeof(packed_position) << " bytes, parsed "
+            << n / parsing.count() << " per second from " << text.size()
+            << " bytes of FEN (checksum " << checksum << ")" << std::endl;
+  return 0;
+}
+
+// positions -w file < records
+//   Packs FEN or EPD lines into a position file. Of EPD operations, `ce` is kept as the score
+//   and `c9` as the outcome.
+// positions [-t] file
+//   Prints the records as FEN; -t instead times reading them against parsing them as FEN.
+int main(const int argc, char *const argv[]) {
+  std::cin.tie(nullptr)->sync_with_stdio(false);
+  bool writing = false, timing = false, usage = false;
+  for (int opt; (opt = getopt(argc, argv, "wt")) != -1;) {
+    switch (opt) {
+    case 'w':
+      writing = true;
+      break;
+    case 't':
+      timing = true;
+      break;
+    default:
+      usage = true;
+    }
+  }
+  if (usage || (writing && timing) || optind + 1 != argc) {
+    std::cerr << "usage: " << argv[0] << " -w file < records\n"
+              << "       " << argv[0] << " [-t] file\n";
+    return 2;
+  }
+  if (writing) {
+    return pack(argv[optind]);
+  }
+  const auto store = position_store::open(argv[optind]);
+  if (!store) {
+    return 1;
+  }
+  return timing ? benchmark(*store) : print(*store);
+}
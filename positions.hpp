@@ -0,0 +1,321 @@
+// Positions packed into fixed-size records, and files of them read in place through mmap.
+#pragma once
+#include "chess.hpp"
+#include "fen.hpp"
+#include "mapped_file.hpp"
+#include <algorithm>
+#include <bit>
+#include <cstdio>
+#include <limits>
+#include <mutex>
+#include <optional>
+#include <span>
+#include <sys/mman.h>
+#include <utility>
+#include <vector>
+
+/** How the game of a position ended, if known. */
+enum class outcome : uint8_t { unknown, white_wins, draw, black_wins };
+
+/**
+ * A position in 32 bytes: the squares occupied by either color, then a nibble per occupied
+ * square from the lowest up, as `side::get_pieces` has them but with 8 added for white; at most
+ * 32 pieces fill two words. An optional score and outcome come along for training data.
+ */
+struct packed_position {
+  static constexpr int16_t no_score = std::numeric_limits<int16_t>::min();
+
+  uint64_t occupancy;
+  std::array<uint64_t, 2> pieces;
+  uint8_t state;            // The castling rights in the low 4 bits, plus 16 if white is to move.
+  uint8_t en_passant;       // 1 + the square, or 0 if none.
+  uint8_t halfmove_clock;   // Saturated, which the fifty-move rule does not mind.
+  outcome result;
+  int16_t score;            // Centipawns for the side to move, or `no_score`.
+  uint16_t fullmove_number; // Saturated.
+
+  /** Packs `config`; the counters, score and outcome are whatever the caller knows. */
+  template <class Side>
+  [[nodiscard]] static constexpr packed_position
+  pack(const basic_configuration<Side> &config, const fen_counters counters = {},
+       const int16_t score = no_score, const outcome result = outcome::unknown) noexcept {
+    std::array<uint8_t, 64> board{};
+    for (const auto [p, s] : config.get_white()) {
+      board[s] = std::to_underlying(p) | 8;
+    }
+    for (const auto [p, s] : config.get_black()) {
+      board[s] = std::to_underlying(p);
+    }
+    packed_position record{};
+    record.occupancy = config.get_white().get_occupancy() | config.get_black().get_occupancy();
+    size_t n = 0;
+    for (auto o = record.occupancy; o; o &= o - 1, ++n) {
+      record.pieces[n / 16] |= uint64_t{board[std::countr_zero(o)]} << 4 * (n % 16);
+    }
+    record.state = config.get_castling() | config.is_white_turn() << 4;
+    const auto en_passant = config.get_en_passant();
+    record.en_passant = en_passant ? 1 + std::countr_zero(en_passant) : 0;
+    record.halfmove_clock = std::min(counters.halfmove_clock, 255U);
+    record.result = result;
+    record.score = score;
+    record.fullmove_number = std::min(counters.fullmove_number, 65'535U);
+    return record;
+  }
+
+private:
+  /** Deals the pieces out to their colors, as `side::from` takes them; whether they are valid. */
+  constexpr bool split(std::array<uint64_t, 2> &own,
+                       std::array<uint64_t, 2> &nibbles) const noexcept {
+    const auto n = std::popcount(occupancy);
+#ifdef __BMI2__
+    if !consteval {
+      constexpr uint64_t lows = 0x1111'1111'1111'1111;
+      // Bit i of `white` is set if the ith piece is white; each word holds 16 pieces.
+      const auto colors = [](const uint64_t word) { return _pext_u64(word >> 3, lows); };
+      const auto present = (uint64_t{1} << n) - 1;
+      const auto white = (colors(pieces[0]) | colors(pieces[1]) << 16) & present;
+      const std::array<uint64_t, 2> by_color{~white & present, white};
+      for (const bool is_white : {false, true}) {
+        const auto mine = by_color[is_white];
+        const auto low = mine & 0xFFFF;
+        const auto count = std::popcount(low);
+        const auto nibbles_of = [](const uint64_t word, const uint64_t which) {
+          return _pext_u64(word & lows * 7, _pdep_u64(which, lows) * 0xF);
+        };
+        const auto high = nibbles_of(pieces[1], mine >> 16);
+        nibbles[is_white] = nibbles_of(pieces[0], low) | (count < 16 ? high << 4 * count : 0);
+        own[is_white] = _pdep_u64(mine, occupancy);
+        if (std::popcount(mine) > 16) {
+          return false;
+        }
+      }
+      // Every piece is one of pawn to king, 1 to 6: neither 0 nor 7.
+      for (size_t word = 0; word < 2; ++word) {
+        const auto x = pieces[word] & lows * 7;
+        const auto used = _pdep_u64(present >> 16 * word, lows);
+        if (((x | x >> 1 | x >> 2) & used) != used || (x & x >> 1 & x >> 2 & used)) {
+          return false;
+        }
+      }
+      return true;
+    }
+#endif
+    std::array<int, 2> count{};
+    size_t i = 0;
+    for (auto o = occupancy; o; o &= o - 1, ++i) {
+      const auto nibble = pieces[i / 16] >> 4 * (i % 16) & 0xF;
+      const auto p = nibble & 7;
+      const bool is_white = nibble & 8;
+      if (p == 0 || p > std::to_underlying(piece::king) || count[is_white] == 16) {
+        return false;
+      }
+      own[is_white] |= o & -o;
+      nibbles[is_white] |= p << 4 * count[is_white]++;
+    }
+    return n <= 32;
+  }
+
+public:
+  /**
+   * The position, and its move counters in `counters`; nothing if the record does not hold a
+   * position, as from a corrupted file.
+   */
+  template <class Side = side>
+  [[nodiscard]] constexpr std::optional<basic_configuration<Side>>
+  unpack(fen_counters &counters) const noexcept {
+    const bool white_turn = state & 16;
+    if (std::popcount(occupancy) > 32 || state >> 5 || en_passant > 64) {
+      return std::nullopt;
+    }
+    std::array<uint64_t, 2> own{}, nibbles{}; // By color: [black, white]
+    if (!split(own, nibbles)) {
+      return std::nullopt;
+    }
+    const auto white = Side::from(own[true], nibbles[true]);
+    const auto black = Side::from(own[false], nibbles[false]);
+    if (std::popcount(white.get_bitboard(piece::king)) != 1 ||
+        std::popcount(black.get_bitboard(piece::king)) != 1) {
+      return std::nullopt;
+    }
+    constexpr uint64_t last_ranks = 0xFF00'0000'0000'00FF;
+    if ((white.get_bitboard(piece::pawn) | black.get_bitboard(piece::pawn)) & last_ranks) {
+      return std::nullopt;
+    }
+    uint64_t mask = 0;
+    if (en_passant) {
+      const square s = en_passant - 1;
+      if (!impl::en_passant_possible(white, black, white_turn, s)) {
+        return std::nullopt;
+      }
+      mask = uint64_t{1} << s;
+    }
+    const uint8_t castling = state & 0b1111;
+    if (impl::castling_kept(white, black, castling) != castling) {
+      return std::nullopt;
+    }
+    counters = {halfmove_clock, fullmove_number};
+    return basic_configuration<Side>(white, black, white_turn, castling, mask);
+  }
+
+  template <class Side = side>
+  [[nodiscard]] constexpr std::optional<basic_configuration<Side>> unpack() const noexcept {
+    fen_counters counters;
+    return unpack<Side>(counters);
+  }
+};
+
+static_assert(sizeof(packed_position) == 32 && std::is_trivially_copyable_v<packed_position>);
+static_assert(configuration().get_key() ==
+              packed_position::pack(configuration()).unpack()->get_key());
+static_assert([] {
+  // An en passant square is checked as in FEN: e6, with no pawn on e5 to take.
+  auto record = packed_position::pack(*parse_fen("4k3/8/8/3P4/8/8/8/4K3 w - - 0 1"));
+  record.en_passant = 1 + 43;
+  return !record.unpack();
+}());
+
+namespace impl {
+
+// A position file: this 64-byte header, then the records, little endian.
+struct position_file_header {
+  std::array<char, 8> magic{'C', 'H', 'E', 'S', 'S', 'P', 'O', 'S'};
+  uint32_t version = 1;
+  uint32_t record_size = sizeof(packed_position);
+  std::array<char, 48> reserved{};
+
+  [[nodiscard]] bool operator==(const position_file_header &) const = default;
+};
+static_assert(sizeof(position_file_header) == 64);
+static_assert(std::endian::native == std::endian::little);
+
+} // namespace impl
+
+/** Appends records to a new position file, through the buffer of the C library. */
+class position_writer {
+  std::FILE *file;
+
+  explicit position_writer(std::FILE *const file) noexcept : file(file) {}
+
+public:
+  /** Creates or truncates the file at `path`; nothing if it cannot. */
+  [[nodiscard]] static std::optional<position_writer> create(const char *const path) noexcept {
+    std::FILE *const file = std::fopen(path, "wb");
+    const impl::position_file_header header;
+    if (!file || std::fwrite(&header, sizeof(header), 1, file) != 1) {
+      std::perror(path);
+      if (file) {
+        std::fclose(file);
+      }
+      return std::nullopt;
+    }
+    return position_writer(file);
+  }
+
+  position_writer(position_writer &&other) noexcept
+      : file(std::exchange(other.file, nullptr)) {}
+  position_writer(const position_writer &) = delete;
+  position_writer &operator=(const position_writer &) = delete;
+  ~position_writer() { close(); }
+
+  /** Whether the record could be buffered. */
+  bool write(const packed_position &record) noexcept {
+    return std::fwrite(&record, sizeof(record), 1, file) == 1;
+  }
+
+  /** Whether all of `records` could be buffered; they go to the C library in one call. */
+  bool write(const std::span<const packed_position> records) noexcept {
+    return std::fwrite(records.data(), sizeof(packed_position), records.size(), file) ==
+           records.size();
+  }
+
+  /** Flushes the records; whether all of them made it to the file. */
+  bool close() noexcept {
+    return !file || std::fclose(std::exchange(file, nullptr)) == 0;
+  }
+};
+
+/**
+ * Collects the records of several workers, each in a buffer of its own, and writes a full buffer
+ * out at once, so that workers seldom wait on each other for the file.
+ */
+class batched_writer {
+  position_writer &writer;
+  std::mutex mutex;
+  std::vector<std::vector<packed_position>> batches; // By worker.
+  bool ok = true;
+
+public:
+  static constexpr size_t batch_size = 1 << 14;
+
+  batched_writer(position_writer &writer, const unsigned threads)
+      : writer(writer), batches(threads) {
+    for (auto &batch : batches) {
+      batch.reserve(batch_size);
+    }
+  }
+
+  void flush(const unsigned self) {
+    auto &batch = batches[self];
+    const std::lock_guard lock(mutex);
+    ok = ok && writer.write(batch);
+    batch.clear();
+  }
+
+  void write(const unsigned self, const packed_position &record) {
+    batches[self].push_back(record);
+    if (batches[self].size() == batch_size) {
+      flush(self);
+    }
+  }
+
+  /** Writes what is left; whether every record was buffered. */
+  bool finish() {
+    for (unsigned self = 0; self < batches.size(); ++self) {
+      flush(self);
+    }
+    return ok;
+  }
+};
+
+/** A position file mapped read-only: its records are read where they lie, in any order. */
+class position_store {
+  mapped_file file;
+
+  explicit position_store(mapped_file &&file) noexcept : file(std::move(file)) {}
+
+public:
+  /** Maps the file at `path`; nothing if it cannot or the file is no position file. */
+  [[nodiscard]] static std::optional<position_store> open(const char *const path) noexcept {
+    auto file = mapped_file::open(path);
+    if (!file) {
+      return std::nullopt;
+    }
+    const auto bytes = file->size();
+    if (bytes < sizeof(impl::position_file_header) ||
+        (bytes - sizeof(impl::position_file_header)) % sizeof(packed_position) != 0) {
+      std::fprintf(stderr, "%s: not a position file\n", path);
+      return std::nullopt;
+    }
+    if (*file->at<impl::position_file_header>(0) != impl::position_file_header{}) {
+      std::fprintf(stderr, "%s: not a position file of this version\n", path);
+      return std::nullopt;
+    }
+    return position_store(std::move(*file));
+  }
+
+  [[nodiscard]] std::span<const packed_position> records() const noexcept {
+    return {file.at<packed_position>(sizeof(impl::position_file_header)),
+            (file.size() - sizeof(impl::position_file_header)) / sizeof(packed_position)};
+  }
+
+  [[nodiscard]] size_t size() const noexcept { return records().size(); }
+  [[nodiscard]] const packed_position &operator[](const size_t i) const noexcept {
+    assert(i < size());
+    return records()[i];
+  }
+  [[nodiscard]] auto begin() const noexcept { return records().begin(); }
+  [[nodiscard]] auto end() const noexcept { return records().end(); }
+
+  /** Tells the kernel the records will be read in order, for a pass over a large file. */
+  void advise_sequential() const noexcept { file.advise(MADV_SEQUENTIAL); }
+};
@@ -0,0 +1,147 @@
+// https://www.chessprogramming.org/UCI
+#include "arguments.hpp"
+#include "book.hpp"
+#include "chess.hpp"
+#include "fen.hpp"
+#include "lazy_smp.hpp"
+#include "nnue.hpp"
+#include "search.hpp"
+#include "uci.hpp"
+#include <iostream>
+#include <unistd.h>
+
+void print(const search_report &report) {
+  const auto milliseconds =
+      std::chrono::duration_cast<std::chrono::milliseconds>(report.elapsed).count();
+  const auto seconds = std::chrono::duration<double>(report.elapsed).count();
+  std::cout << "info depth " << report.depth << " score ";
+  if (std::abs(report.score) >= searcher::mate_bound) {
+    // In moves, not plies; negative when the side to move is getting mated.
+    const auto plies = searcher::mate - std::abs(report.score);
+    std::cout << "mate " << (report.score > 0 ? (plies + 1) / 2 : -plies / 2);
+  } else {
+    std::cout << "cp " << report.score;
+  }
+  std::cout << " nodes " << report.nodes << " nps "
+            << static_cast<uint64_t>(report.nodes / std::max(seconds, 1e-9)) << " time "
+            << milliseconds << " pv";
+  for (const auto m : report.pv) {
+    std::cout << ' ' << m;
+  }
+  std::cout << std::endl;
+}
+
+// search [-j threads] [-d depth] [-n nodes] [-t milliseconds] [-H hash-megabytes] [-e network]
+//        [-b book] [-s] [fen]
+//   Without any limit, searches for a second. Prints one line per completed iteration, in the
+//   format of UCI info lines, and the best move last.
+//   -e  evaluate with the network in the given file instead of the piece-square tables.
+//   -b  play the heaviest move of the book in the given file, if it has one, without searching.
+//   -s  instead time the search to the given depth, 12 by default, on 1, 2, 4, ... threads.
+int main(const int argc, char *const argv[]) {
+  std::cin.tie(nullptr)->sync_with_stdio(false);
+  unsigned threads = std::max(std::thread::hardware_concurrency(), 1U);
+  search_limits limits;
+  size_t hash_megabytes = 64;
+  const char *network_file = nullptr, *book_file = nullptr;
+  bool limited = false, scaling = false, usage = false;
+  for (int opt; (opt = getopt(argc, argv, "j:d:n:t:H:e:b:s")) != -1;) {
+    switch (opt) {
+    case 'j':
+      usage |= !parse(optarg, threads) || threads == 0;
+      break;
+    case 'd':
+      usage |= !parse(optarg, limits.depth) || limits.depth < 1;
+      limited = true;
+      break;
+    case 'n':
+      usage |= !parse(optarg, limits.nodes);
+      limited = true;
+      break;
+    case 't': {
+      std::chrono::milliseconds::rep milliseconds;
+      usage |= !parse(optarg, milliseconds);
+      limits.time = std::chrono::milliseconds(milliseconds);
+      limited = true;
+      break;
+    }
+    case 'H':
+      usage |= !parse(optarg, hash_megabytes);
+      break;
+    case 'e':
+      network_file = optarg;
+      break;
+    case 'b':
+      book_file = optarg;
+      break;
+    case 's':
+      scaling = true;
+      break;
+    default:
+      usage = true;
+    }
+  }
+  const auto root = optind < argc ? parse_fen(argv[optind]) : configuration();
+  if (usage || !root) {
+    std::cerr << "usage: " << argv[0]
+              << " [-j threads] [-d depth] [-n nodes] [-t milliseconds] [-H hash-megabytes]"
+                 " [-e network] [-b book] [-s] [fen]\n";
+    return 2;
+  }
+  const auto book = book_file ? opening_book::open(book_file) : std::nullopt;
+  if (book_file && !book) {
+    return 1;
+  }
+  if (const auto m = book && !scaling ? book->best(*root) : std::nullopt) {
+    std::cout << "info string book move\nbestmove " << *m << std::endl;
+    return 0;
+  }
+  const auto network = network_file ? nnue::network::load(network_file) : std::nullopt;
+  if (network_file && !network) {
+    return 1;
+  }
+  transposition_table table(hash_megabytes);
+  lazy_smp engine(table, threads, network ? &*network : nullptr);
+
+  if (scaling) {
+    // Time to depth: the same work on more threads, each run starting from an empty table.
+    if (!limited) {
+      limits.depth = 12;
+    }
+    std::chrono::duration<double> single{};
+    for (unsigned n = 1;; n = std::min(n * 2, threads)) {
+      table.clear();
+      const auto start = std::chrono::steady_clock::now();
+      const auto result = engine.search(*root, limits, [](const search_report &) {}, {}, n);
+      const std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+      if (n == 1) {
+        single = elapsed;
+      }
+      const auto speedup = single / elapsed;
+      std::cout << n << " threads: depth " << result.depth << ", " << elapsed.count() << " s, "
+                << result.nodes << " nodes, speedup " << speedup << ", efficiency "
+                << speedup / n << '\n';
+      if (n == threads) {
+        break;
+      }
+    }
+    std::cout << std::flush;
+    return 0;
+  }
+
+  if (!limited) {
+    limits.time = std::chrono::seconds(1);
+  }
+  const auto start = std::chrono::steady_clock::now();
+  const auto result = engine.search(*root, limits, print);
+  const std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+  std::cout << "info string " << elapsed.count() << " s, " << result.nodes
+            << " nodes, hash hit rate " << engine.get_counters().hit_rate() << ", hashfull "
+            << table.occupancy() << '\n';
+  if (result.best) {
+    std::cout << "bestmove " << *result.best << '\n';
+  } else {
+    std::cout << "bestmove 0000\n";
+  }
+  std::cout << std::flush;
+}
@@ -0,0 +1,423 @@
+// https://www.chessprogramming.org/Principal_Variation_Search
+#pragma once
+#include "chess.hpp"
+#include "evaluation.hpp"
+#include "move_picker.hpp"
+#include "nnue.hpp"
+#include "transposition.hpp"
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <limits>
+#include <optional>
+#include <span>
+#include <vector>
+
+/** When a search must stop; whichever limit is reached first ends it. */
+struct search_limits {
+  int depth = std::numeric_limits<int>::max();
+  uint64_t nodes = std::numeric_limits<uint64_t>::max();
+  std::chrono::milliseconds time = std::chrono::milliseconds::max();
+};
+
+/** What an iteration of the search found, reported as soon as it completes. */
+struct search_report {
+  int depth, score;
+  uint64_t nodes;
+  std::chrono::nanoseconds elapsed;
+  std::vector<move> pv; // Principal variation: the expected line of play, best move first.
+};
+
+/** What a whole search found. */
+struct search_result {
+  std::optional<move> best; // Nothing when there is no legal move.
+  int depth, score;         // Of the deepest completed iteration; depth 0 if none completed.
+  uint64_t nodes;
+};
+
+namespace impl {
+
+// https://www.chessprogramming.org/Late_Move_Reductions
+inline const auto late_move_reductions = [] {
+  std::array<std::array<int, 64>, 64> reductions{}; // By depth, then by index of the move.
+  for (size_t depth = 1; depth < reductions.size(); ++depth) {
+    for (size_t index = 1; index < reductions[depth].size(); ++index) {
+      const auto d = std::log(static_cast<double>(depth)), i = std::log(static_cast<double>(index));
+      reductions[depth][index] = static_cast<int>(0.75 + d * i / 2.25);
+    }
+  }
+  return reductions;
+}();
+
+// Helper threads of a Lazy SMP search skip some depths, each by its own pattern, so that they
+// spread over the next few iterations instead of all searching the same tree in lockstep.
+constexpr std::array skip_size{1, 1, 2, 2, 2, 2, 3, 3, 3, 3, 3, 3, 4, 4, 4, 4, 4, 4, 4, 4};
+constexpr std::array skip_phase{0, 1, 0, 1, 2, 3, 0, 1, 2, 3, 4, 5, 0, 1, 2, 3, 4, 5, 6, 7};
+
+} // namespace impl
+
+/**
+ * Iterative deepening over a principal variation search with a quiescence search at the leaves,
+ * null move pruning and late move reductions. A searcher owns its copy of the configuration and
+ * makes moves on it in place; the transposition table and the network may be shared. Without a
+ * network, positions are evaluated by `evaluation::evaluate`.
+ */
+class searcher {
+public:
+  static constexpr int max_ply = 128;
+  static constexpr int mate = 32'000, infinity = mate + 1;
+  /** Scores beyond this are mates, `mate - |score|` plies from the root. */
+  static constexpr int mate_bound = mate - max_ply;
+
+private:
+  configuration config;
+  ply_stack plies;
+  transposition_table &table;
+  transposition_table::counters tally;
+  std::vector<uint64_t> history;
+  const std::atomic<bool> *stop; // Raised by another thread to end the search early.
+  const nnue::network *network;
+  std::array<nnue::accumulator, max_ply> accumulators; // By ply, while a network is used.
+  search_limits limits;
+  std::chrono::steady_clock::time_point start;
+  uint64_t nodes = 0;
+  std::atomic<uint64_t> published_nodes = 0; // `nodes` as of the last poll, for other threads.
+  bool stopped = false;
+  // Triangular: the principal variation from ply p is pv[p][p] up to pv[p][pv_length[p]].
+  std::array<std::array<move, max_ply>, max_ply> pv;
+  std::array<int, max_ply> pv_length;
+  std::array<std::array<move, 2>, max_ply> killers; // move(0, 0) where there is none.
+  history_table quiet_history;
+
+  // In milliseconds, which cannot overflow when compared against an unlimited time.
+  [[nodiscard]] std::chrono::milliseconds elapsed() const noexcept {
+    return std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() -
+                                                                 start);
+  }
+
+  /** Whether a limit has been reached; the clock and `stop` are read only every 1024 nodes. */
+  [[nodiscard]] bool poll() noexcept {
+    if (!stopped && (nodes & 1023) == 0) {
+      published_nodes.store(nodes, std::memory_order_relaxed);
+      stopped = elapsed() >= limits.time || (stop && stop->load(std::memory_order_relaxed));
+    }
+    stopped |= nodes >= limits.nodes;
+    return stopped;
+  }
+
+  /**
+   * Whether the current position occurred before with the same side to move, which is scored as
+   * a draw. A capture or null move in between makes that impossible, so the scan stops there.
+   */
+  [[nodiscard]] bool repeated() const noexcept {
+    const auto key = config.get_key();
+    const auto n = plies.size();
+    for (size_t k = n; k-- > 0;) {
+      const auto &p = plies.begin()[k];
+      if (p.captured != piece::empty || p.move == move(0, 0)) {
+        return false;
+      }
+      if ((n - k) % 2 == 0 && p.key == key) {
+        return true;
+      }
+    }
+    for (size_t k = history.size(); k-- > 0;) {
+      if ((n + history.size() - k) % 2 == 0 && history[k] == key) {
+        return true;
+      }
+    }
+    return false;
+  }
+
+  /** Makes `m`, and updates the accumulator of the ply it leads to. */
+  void play(const move m) noexcept {
+    if (!network) {
+      config.make_move(m, plies);
+      return;
+    }
+    const auto ply = plies.size();
+    const auto before = config;
+    config.make_move(m, plies);
+    network->update(accumulators[ply], accumulators[ply + 1], before, m, config);
+  }
+
+  /** Passes, which leaves the accumulator as it is. */
+  void pass() noexcept {
+    if (network) {
+      accumulators[plies.size() + 1] = accumulators[plies.size()];
+    }
+    config.make_null_move(plies);
+  }
+
+  [[nodiscard]] int evaluate() const noexcept {
+    return network ? network->evaluate(accumulators[plies.size()], config.is_white_turn())
+                   : evaluation::evaluate(config);
+  }
+
+  // Mates are stored relative to the node, not to the root, so that they hold in transpositions.
+  [[nodiscard]] static constexpr int to_table(const int score, const int ply) noexcept {
+    return score >= mate_bound ? score + ply : score <= -mate_bound ? score - ply : score;
+  }
+  [[nodiscard]] static constexpr int from_table(const int score, const int ply) noexcept {
+    return score >= mate_bound ? score - ply : score <= -mate_bound ? score + ply : score;
+  }
+
+  [[nodiscard]] const side &us() const noexcept {
+    return config.is_white_turn() ? config.get_white() : config.get_black();
+  }
+  [[nodiscard]] const side &them() const noexcept {
+    return config.is_white_turn() ? config.get_black() : config.get_white();
+  }
+
+  /** The piece `m` takes, if any. */
+  [[nodiscard]] piece victim(const move m) const noexcept {
+    if (m.dst(config.get_en_passant()) && us().get(m.get_src_square()) == piece::pawn) {
+      return piece::pawn;
+    }
+    return them().get(m.get_dst_square());
+  }
+
+  /** Rewards a quiet move that cut off and punishes those tried before it, by `depth`. */
+  void update_quiet_history(const int ply, const int depth, const move cutoff,
+                            const std::span<const move> tried) noexcept {
+    if (cutoff != killers[ply][0]) {
+      killers[ply] = {cutoff, killers[ply][0]};
+    }
+    // Scores approach +-16384 but never leave that range, however often they are updated.
+    const auto bonus = std::min(depth * depth, 1'024);
+    auto &table = quiet_history[config.is_white_turn()];
+    const auto update = [&table](const move m, const int delta) {
+      auto &score = table[m.get_src_square()][m.get_dst_square()];
+      score += delta - score * std::abs(delta) / 16'384;
+    };
+    update(cutoff, bonus);
+    for (const auto m : tried) {
+      update(m, -bonus);
+    }
+  }
+
+  void update_pv(const int ply, const move m) noexcept {
+    pv[ply][ply] = m;
+    for (auto i = ply + 1; i < pv_length[ply + 1]; ++i) {
+      pv[ply][i] = pv[ply + 1][i];
+    }
+    pv_length[ply] = std::max(pv_length[ply + 1], ply + 1);
+  }
+
+  /** Searches captures that do not lose material, and promotions, until the position is quiet. */
+  int quiescence(int alpha, const int beta, const int ply) noexcept {
+    pv_length[ply] = ply;
+    if (poll()) {
+      return 0;
+    }
+    ++nodes;
+    if (ply >= max_ply - 1) {
+      return evaluate();
+    }
+    const bool check = config.in_check();
+    auto best = -infinity;
+    if (!check) {
+      // Standing pat: the side to move is assumed to have a quiet move at least this good.
+      best = evaluate();
+      if (best >= beta) {
+        return best;
+      }
+      alpha = std::max(alpha, best);
+    }
+    // Out of check every evasion is searched.
+    auto picker = check ? move_picker(config, std::nullopt, killers[ply], quiet_history)
+                        : move_picker(config);
+    while (const auto next = picker.next()) {
+      const auto m = *next;
+      play(m);
+      const auto score = -quiescence(-beta, -alpha, ply + 1);
+      config.unmake_move(plies);
+      if (stopped) {
+        return 0;
+      }
+      if (score > best) {
+        best = score;
+        if (score > alpha) {
+          alpha = score;
+          update_pv(ply, m);
+          if (score >= beta) {
+            break;
+          }
+        }
+      }
+    }
+    return best == -infinity ? -mate + ply : best; // Only in check is nothing searched.
+  }
+
+  int negamax(int alpha, const int beta, const int depth, const int ply,
+              const bool null_allowed) noexcept {
+    pv_length[ply] = ply;
+    if (ply > 0 && repeated()) {
+      return 0;
+    }
+    if (depth <= 0 || ply >= max_ply - 1) {
+      return quiescence(alpha, beta, ply);
+    }
+    if (poll()) {
+      return 0;
+    }
+    ++nodes;
+    const bool pv_node = beta - alpha > 1;
+
+    std::optional<move> best_move;
+    if (const auto entry = table.probe(config, tally)) {
+      best_move = entry->best;
+      const auto score = from_table(entry->score, ply);
+      if (!pv_node && entry->depth >= depth &&
+          (entry->bound == transposition_table::bound::exact ||
+           (entry->bound == transposition_table::bound::lower && score >= beta) ||
+           (entry->bound == transposition_table::bound::upper && score <= alpha))) {
+        return score;
+      }
+    }
+
+    const bool check = config.in_check();
+    // Passing is worse than any move unless in zugzwang, which is unlikely with pieces left; if
+    // even passing keeps the score above beta, a reduced search confirms the cutoff.
+    const auto &own = us();
+    const auto pieces = own.get_occupancy() ^ own.get_bitboard(piece::pawn) ^
+                        own.get_bitboard(piece::king);
+    if (!pv_node && !check && null_allowed && depth >= 3 && pieces &&
+        evaluate() >= beta) {
+      const auto reduction = 2 + depth / 6;
+      pass();
+      const auto score = -negamax(-beta, -beta + 1, depth - 1 - reduction, ply + 1, false);
+      config.unmake_null_move(plies);
+      if (stopped) {
+        return 0;
+      }
+      if (score >= beta) {
+        return score >= mate_bound ? beta : score; // A mate found by passing is not trusted.
+      }
+    }
+
+    move_picker picker(config, best_move, killers[ply], quiet_history);
+    if (ply + 1 < max_ply) {
+      killers[ply + 1] = {};
+    }
+    std::array<move, 64> quiets_tried; // For the history, which only minds the first ones.
+    size_t quiets_count = 0;
+    auto best = -infinity;
+    auto bound = transposition_table::bound::upper;
+    for (size_t i = 0; const auto next = picker.next(); ++i) {
+      const auto m = *next;
+      const bool quiet = victim(m) == piece::empty && m.get_promotion() == piece::empty;
+      play(m);
+      table.prefetch(config);
+      int score;
+      if (i == 0) {
+        score = -negamax(-beta, -alpha, depth - 1, ply + 1, true);
+      } else {
+        // Late quiet moves are searched shallower, and again at full depth if they surprise.
+        auto reduction = 0;
+        if (depth >= 3 && i >= 3 && quiet && !check && !config.in_check()) {
+          reduction = impl::late_move_reductions[std::min(depth, 63)][std::min<size_t>(i, 63)];
+          reduction = std::clamp(reduction - pv_node, 0, depth - 2);
+        }
+        score = -negamax(-alpha - 1, -alpha, depth - 1 - reduction, ply + 1, true);
+        if (score > alpha && reduction) {
+          score = -negamax(-alpha - 1, -alpha, depth - 1, ply + 1, true);
+        }
+        if (score > alpha && score < beta) {
+          score = -negamax(-beta, -alpha, depth - 1, ply + 1, true);
+        }
+      }
+      config.unmake_move(plies);
+      if (stopped) {
+        return 0;
+      }
+      if (score > best) {
+        best = score;
+        best_move = m;
+        if (score > alpha) {
+          alpha = score;
+          bound = transposition_table::bound::exact;
+          update_pv(ply, m);
+          if (score >= beta) {
+            bound = transposition_table::bound::lower;
+            if (quiet) {
+              update_quiet_history(ply, depth, m, std::span(quiets_tried).first(quiets_count));
+            }
+            break;
+          }
+        }
+      }
+      if (quiet && quiets_count < quiets_tried.size()) {
+        quiets_tried[quiets_count++] = m;
+      }
+    }
+    if (best == -infinity) {
+      return check ? -mate + ply : 0;
+    }
+    table.store(config, best_move, to_table(best, ply), depth, bound, tally);
+    return best;
+  }
+
+public:
+  /**
+   * Searches `root`, whose game went through the positions keyed by `history`, oldest first.
+   * Only the positions since the last capture or pawn move matter for repetitions.
+   */
+  searcher(const configuration &root, transposition_table &table,
+           std::vector<uint64_t> history = {}, const std::atomic<bool> *stop = nullptr,
+           const nnue::network *network = nullptr)
+      : config(root), table(table), history(std::move(history)), stop(stop), network(network) {}
+
+  /** Nodes searched so far, give or take the last 1024; safe to read from any thread. */
+  [[nodiscard]] uint64_t get_published_nodes() const noexcept {
+    return published_nodes.load(std::memory_order_relaxed);
+  }
+
+  [[nodiscard]] const transposition_table::counters &get_counters() const noexcept {
+    return tally;
+  }
+
+  /**
+   * Deepens one ply at a time until a limit is reached, calling `report` after each completed
+   * iteration. The best move is that of the deepest completed iteration, or any legal move if
+   * not even the first one completed. Thread 0 searches every depth; helper threads of a Lazy
+   * SMP search pass their index to skip some. The caller ages the table with `new_search`.
+   */
+  search_result search(const search_limits &l, auto &&report, const unsigned thread = 0) {
+    limits = l;
+    start = std::chrono::steady_clock::now();
+    nodes = 0;
+    stopped = false;
+    search_result result{std::nullopt, 0, 0, 0};
+    killers = {};
+    quiet_history = {};
+    if (network) {
+      network->refresh(accumulators[0], config);
+    }
+    const auto moves = config.generate_legal_moves();
+    if (!moves.empty()) {
+      result.best = moves[0];
+    }
+    for (int depth = 1; !moves.empty() && depth <= std::min(limits.depth, max_ply - 1); ++depth) {
+      if (const auto i = (thread - 1) % impl::skip_size.size();
+          thread > 0 && (depth + impl::skip_phase[i]) / impl::skip_size[i] % 2) {
+        continue;
+      }
+      const auto score = negamax(-infinity, infinity, depth, 0, false);
+      if (stopped) {
+        break;
+      }
+      result = {pv[0][0], depth, score, nodes};
+      const auto spent = std::chrono::steady_clock::now() - start;
+      report(search_report{depth, score, nodes, spent,
+                           std::vector(pv[0].begin(), pv[0].begin() + pv_length[0])});
+      // The next iteration takes several times as long as this one; do not start it in vain.
+      if (elapsed() * 2 > limits.time || std::abs(score) >= mate_bound) {
+        break;
+      }
+    }
+    result.nodes = nodes;
+    published_nodes.store(nodes, std::memory_order_relaxed);
+    return result;
+  }
+};
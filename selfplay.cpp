@@ -0,0 +1,243 @@
+// Plays games of the engine against itself on every core and writes their positions, with the
+// score of the search and the outcome of the game, to a position file: training data.
+#include "arguments.hpp"
+#include "chess.hpp"
+#include "nnue.hpp"
+#include "positions.hpp"
+#include "search.hpp"
+#include "transposition.hpp"
+#include <atomic>
+#include <chrono>
+#include <cstring>
+#include <iostream>
+#include <memory>
+#include <thread>
+#include <unistd.h>
+#include <vector>
+
+struct selfplay_options {
+  search_limits limits;
+  uint64_t seed = 0;
+  unsigned random_plies = 8;  // Uniformly random moves that open each game.
+  unsigned max_plies = 400;   // After which a game is adjudicated a draw.
+  size_t hash_megabytes = 16; // For each thread.
+  const nnue::network *network = nullptr;
+};
+
+struct selfplay_stats {
+  uint64_t games = 0, plies = 0, positions = 0;
+  std::array<uint64_t, 4> outcomes{}; // By outcome.
+
+  selfplay_stats &operator+=(const selfplay_stats &other) noexcept {
+    games += other.games;
+    plies += other.plies;
+    positions += other.positions;
+    for (size_t i = 0; i < outcomes.size(); ++i) {
+      outcomes[i] += other.outcomes[i];
+    }
+    return *this;
+  }
+};
+
+/** Whether neither side can ever mate: bare kings, or a lone knight or bishop besides them. */
+bool insufficient_material(const configuration &config) {
+  const auto &white = config.get_white(), &black = config.get_black();
+  const auto pieces = std::popcount(white.get_occupancy() | black.get_occupancy());
+  const auto minors = white.get_bitboard(piece::knight) | white.get_bitboard(piece::bishop) |
+                      black.get_bitboard(piece::knight) | black.get_bitboard(piece::bishop);
+  return pieces == 2 || (pieces == 3 && minors);
+}
+
+/**
+ * Plays games on one thread, each from its own seed and with a cleared table, so that a game
+ * depends only on its number and the options, not on which thread plays it or what it played
+ * before. The buffers are kept from game to game.
+ */
+class selfplay_worker {
+  const selfplay_options &options;
+  transposition_table table;
+  std::vector<uint64_t> keys; // Since the last capture or pawn move, oldest first.
+  std::vector<packed_position> positions;
+  selfplay_stats stats;
+
+  /** A position some random plies into the game, with a legal move left to play. */
+  configuration opening(uint64_t &random, fen_counters &counters) const {
+    for (;;) {
+      configuration config;
+      counters = {};
+      for (unsigned ply = 0; ply < options.random_plies; ++ply) {
+        const auto moves = config.generate_legal_moves();
+        if (moves.empty()) {
+          break;
+        }
+        const auto m = moves[splitmix64(random) % moves.size()];
+        counters.advance(config, m);
+        config = config.play(m);
+      }
+      if (!config.generate_legal_moves().empty()) {
+        return config;
+      }
+    }
+  }
+
+public:
+  explicit selfplay_worker(const selfplay_options &options)
+      : options(options), table(options.hash_megabytes) {}
+
+  [[nodiscard]] const selfplay_stats &get_stats() const noexcept { return stats; }
+
+  /** Plays game number `game` and hands each of its positions, labelled, to `out`. */
+  void play(const uint64_t game, auto &&out) {
+    auto seed = options.seed;
+    uint64_t random = splitmix64(seed) + game; // The state of the generator.
+    fen_counters counters;
+    auto config = opening(random, counters);
+    table.clear();
+    keys.clear();
+    positions.clear();
+    auto result = outcome::draw;
+    for (unsigned ply = 0;; ++ply) {
+      if (config.generate_legal_moves().empty()) {
+        if (config.in_check()) {
+          result = config.is_white_turn() ? outcome::black_wins : outcome::white_wins;
+        }
+        break;
+      }
+      const auto key = config.get_key();
+      if (counters.halfmove_clock >= 100 || insufficient_material(config) ||
+          std::ranges::count(keys, key) >= 2 || ply >= options.max_plies) {
+        break;
+      }
+      table.new_search();
+      const auto engine =
+          std::make_unique<searcher>(config, table, keys, nullptr, options.network);
+      const auto found = engine->search(options.limits, [](const search_report &) {});
+      const auto m = *found.best;
+      // Positions in check or with a mate in sight say little about how to evaluate.
+      if (!config.in_check() && std::abs(found.score) < searcher::mate_bound) {
+        positions.push_back(packed_position::pack(config, counters, found.score));
+      }
+      if (counters.advance(config, m)) {
+        keys.clear();
+      } else {
+        keys.push_back(key);
+      }
+      config = config.play(m);
+      ++stats.plies;
+    }
+    for (auto record : positions) {
+      record.result = result;
+      out(record);
+    }
+    ++stats.games;
+    stats.positions += positions.size();
+    ++stats.outcomes[std::to_underlying(result)];
+  }
+};
+
+// selfplay [-j threads] [-g games] [-d depth] [-n nodes] [-r random-plies] [-m max-plies]
+//          [-s seed] [-H hash-megabytes] [-e network] file
+//   Plays the games, searching each move to the depth or number of nodes, 5000 nodes by
+//   default, and writes every position not in check and not mated to a position file. Games
+//   with the same seed and options are the same whatever the number of threads; on more than
+//   one thread, only the order of their positions in the file changes.
+//   -e  evaluate with the network in the given file instead of the piece-square tables.
+int main(const int argc, char *const argv[]) {
+  std::cin.tie(nullptr)->sync_with_stdio(false);
+  unsigned threads = std::max(std::thread::hardware_concurrency(), 1U);
+  uint64_t games = 1'000;
+  selfplay_options options;
+  const char *network_file = nullptr;
+  bool limited = false, usage = false;
+  for (int opt; (opt = getopt(argc, argv, "j:g:d:n:r:m:s:H:e:")) != -1;) {
+    switch (opt) {
+    case 'j':
+      usage |= !parse(optarg, threads) || threads == 0;
+      break;
+    case 'g':
+      usage |= !parse(optarg, games);
+      break;
+    case 'd':
+      usage |= !parse(optarg, options.limits.depth) || options.limits.depth < 1;
+      limited = true;
+      break;
+    case 'n':
+      usage |= !parse(optarg, options.limits.nodes);
+      limited = true;
+      break;
+    case 'r':
+      usage |= !parse(optarg, options.random_plies);
+      break;
+    case 'm':
+      usage |= !parse(optarg, options.max_plies);
+      break;
+    case 's':
+      usage |= !parse(optarg, options.seed);
+      break;
+    case 'H':
+      usage |= !parse(optarg, options.hash_megabytes);
+      break;
+    case 'e':
+      network_file = optarg;
+      break;
+    default:
+      usage = true;
+    }
+  }
+  if (usage || optind + 1 != argc) {
+    std::cerr << "usage: " << argv[0]
+              << " [-j threads] [-g games] [-d depth] [-n nodes] [-r random-plies]"
+                 " [-m max-plies] [-s seed] [-H hash-megabytes] [-e network] file\n";
+    return 2;
+  }
+  if (!limited) {
+    options.limits.nodes = 5'000;
+  }
+  const auto network = network_file ? nnue::network::load(network_file) : std::nullopt;
+  if (network_file && !network) {
+    return 1;
+  }
+  options.network = network ? &*network : nullptr;
+  auto writer = position_writer::create(argv[optind]);
+  if (!writer) {
+    return 1;
+  }
+
+  const auto start = std::chrono::steady_clock::now();
+  batched_writer out(*writer, threads);
+  std::atomic<uint64_t> next_game = 0;
+  std::vector<selfplay_stats> stats(threads);
+  const auto work = [&](const unsigned self) {
+    selfplay_worker worker(options);
+    for (uint64_t game; (game = next_game.fetch_add(1, std::memory_order_relaxed)) < games;) {
+      worker.play(game, [&out, self](const packed_position &record) { out.write(self, record); });
+    }
+    stats[self] = worker.get_stats();
+  };
+  std::vector<std::thread> workers;
+  for (unsigned self = 1; self < threads; ++self) {
+    workers.emplace_back(work, self);
+  }
+  work(0);
+  for (auto &worker : workers) {
+    worker.join();
+  }
+  const bool ok = out.finish() && writer->close();
+  if (!ok) {
+    std::perror(argv[optind]);
+  }
+  const std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+
+  selfplay_stats total;
+  for (const auto &s : stats) {
+    total += s;
+  }
+  const auto hours = std::max(elapsed.count(), 1e-9) / 3600;
+  std::cout << total.games << " games (+" << total.outcomes[std::to_underlying(outcome::white_wins)]
+            << " =" << total.outcomes[std::to_underlying(outcome::draw)] << " -"
+            << total.outcomes[std::to_underlying(outcome::black_wins)] << "), " << total.plies
+            << " plies, " << total.positions << " positions in " << elapsed.count() << " s on "
+            << threads << " threads: " << static_cast<uint64_t>(total.positions / hours)
+            << " positions/h" << std::endl;
+  return ok ? 0 : 1;
+}
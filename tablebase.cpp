@@ -0,0 +1,134 @@
+// Builds endgame tables into a directory, and probes positions against them.
+#include "arguments.hpp"
+#include "chess.hpp"
+#include "fen.hpp"
+#include "tablebase.hpp"
+#include <chrono>
+#include <cstring>
+#include <iostream>
+#include <string>
+#include <thread>
+#include <unistd.h>
+#include <vector>
+
+/** Writes `table` to its file, and with `check`, reads every valid entry back from it. */
+bool save(const std::string &directory, const tablebase::built_table &table, const bool check) {
+  const auto path = directory + '/' + table.m.name() + ".tb";
+  if (!tablebase::write_table(path.c_str(), table.m, table.entries, table.invalid)) {
+    std::perror(path.c_str());
+    return false;
+  }
+  std::array<size_t, 3> counts{}; // Losses, draws and wins.
+  for (size_t i = 0; i < table.entries.size(); ++i) {
+    if (!(table.invalid[i / 64] >> i % 64 & 1)) {
+      ++counts[1 + std::to_underlying(tablebase::probe_result::of(table.entries[i]).value)];
+    }
+  }
+  std::error_code error;
+  const auto bytes = std::filesystem::file_size(path, error);
+  std::cout << table.m.name() << ": " << table.entries.size() << " entries, " << counts[2]
+            << " won, " << counts[1] << " drawn, " << counts[0] << " lost, longest mate "
+            << table.max_plies << " plies, " << bytes << " bytes, "
+            << std::chrono::duration<double>(table.elapsed).count() << " s" << std::endl;
+  if (!check) {
+    return true;
+  }
+  const auto file = tablebase::table_file::open(path.c_str());
+  if (!file) {
+    return false;
+  }
+  for (size_t i = 0; i < table.entries.size(); ++i) {
+    if (!(table.invalid[i / 64] >> i % 64 & 1) && (*file)[i] != table.entries[i]) {
+      std::cerr << path << ": entry " << i << " reads back wrong\n";
+      return false;
+    }
+  }
+  return true;
+}
+
+int probe(const char *const directory, char *const fens[], const int count) {
+  const tablebase::prober prober(directory);
+  int status = 0;
+  for (int i = 0; i < count; ++i) {
+    const auto config = parse_fen(fens[i]);
+    const auto result = config ? prober.probe(*config) : std::nullopt;
+    std::cout << fens[i] << ": ";
+    if (!result) {
+      std::cout << (config ? "not in the tables\n" : "not a FEN record\n");
+      status = 1;
+      continue;
+    }
+    using wdl = tablebase::probe_result::wdl;
+    switch (result->value) {
+    case wdl::win:
+      std::cout << "win, mate in " << (result->plies + 1) / 2 << " moves\n";
+      break;
+    case wdl::draw:
+      std::cout << "draw\n";
+      break;
+    case wdl::loss:
+      std::cout << "loss, mated in " << result->plies / 2 << " moves\n";
+      break;
+    }
+  }
+  std::cout << std::flush;
+  return status;
+}
+
+// tablebase [-j threads] [-d directory] [-c] material...
+//   Builds the tables of the materials, named like KRPvKR with up to 5 pieces, and of the
+//   materials they lead to, into the directory, the current one by default. -c reads every table
+//   back from its file.
+// tablebase -p [-d directory] fen...
+//   Probes the positions against the tables of the directory.
+int main(const int argc, char *const argv[]) {
+  std::cin.tie(nullptr)->sync_with_stdio(false);
+  unsigned threads = std::max(std::thread::hardware_concurrency(), 1U);
+  std::string directory = ".";
+  bool probing = false, check = false, usage = false;
+  for (int opt; (opt = getopt(argc, argv, "j:d:cp")) != -1;) {
+    switch (opt) {
+    case 'j':
+      usage |= !parse(optarg, threads) || threads == 0;
+      break;
+    case 'd':
+      directory = optarg;
+      break;
+    case 'c':
+      check = true;
+      break;
+    case 'p':
+      probing = true;
+      break;
+    default:
+      usage = true;
+    }
+  }
+  std::vector<tablebase::material> materials;
+  for (int i = optind; !probing && i < argc; ++i) {
+    const auto m = tablebase::material::parse(argv[i]);
+    if (!m || m->pieces() == 2) {
+      std::cerr << argv[i] << ": not a material of 3 to " << tablebase::max_pieces << " pieces\n";
+      usage = true;
+    } else {
+      materials.push_back(m->canonical());
+    }
+  }
+  if (usage || optind == argc) {
+    std::cerr << "usage: " << argv[0] << " [-j threads] [-d directory] [-c] material...\n"
+              << "       " << argv[0] << " -p [-d directory] fen...\n";
+    return 2;
+  }
+  if (probing) {
+    return probe(directory.c_str(), argv + optind, argc - optind);
+  }
+
+  tablebase::generator generator(threads);
+  bool ok = true;
+  for (const auto &m : materials) {
+    generator.build(m, [&](const tablebase::built_table &table) {
+      ok = save(directory, table, check) && ok;
+    });
+  }
+  return ok ? 0 : 1;
+}
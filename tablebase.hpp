@@ -0,0 +1,831 @@
+// https://www.chessprogramming.org/Endgame_Tablebases
+// https://www.chessprogramming.org/Retrograde_Analysis
+#pragma once
+#include "chess.hpp"
+#include "mapped_file.hpp"
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <bit>
+#include <chrono>
+#include <cstdio>
+#include <filesystem>
+#include <limits>
+#include <optional>
+#include <span>
+#include <string>
+#include <string_view>
+#include <system_error>
+#include <thread>
+#include <utility>
+#include <vector>
+
+namespace tablebase {
+
+/** Kings included. */
+constexpr size_t max_pieces = 5;
+
+/**
+ * The pieces of an endgame besides the two kings. Tables are kept for the canonical side of each
+ * material only, where white is at least as strong as black; the other is probed color-flipped.
+ */
+class material {
+  std::array<std::array<uint8_t, 7>, 2> counts{}; // By color [black, white], then by piece.
+
+public:
+  /** The order of the pieces of each color in an index, strongest first. */
+  static constexpr std::array order{piece::queen, piece::rook, piece::bishop, piece::knight,
+                                    piece::pawn};
+
+  template <class Side>
+  [[nodiscard]] static constexpr material of(const basic_configuration<Side> &config) noexcept {
+    material m;
+    for (const bool is_white : {false, true}) {
+      const auto &s = is_white ? config.get_white() : config.get_black();
+      for (const auto p : order) {
+        m.counts[is_white][std::to_underlying(p)] = std::popcount(s.get_bitboard(p));
+      }
+    }
+    return m;
+  }
+
+  /** The material named like `KRPvKR`; nothing if the name is malformed or has too many pieces. */
+  [[nodiscard]] static constexpr std::optional<material> parse(const std::string_view name) {
+    constexpr std::string_view letters = ".PRNBQ"; // Indexed by piece.
+    const auto v = name.find('v');
+    if (v == name.npos || name[0] != 'K' || v + 1 >= name.size() || name[v + 1] != 'K') {
+      return std::nullopt;
+    }
+    material m;
+    for (const bool is_white : {true, false}) {
+      const auto pieces = is_white ? name.substr(1, v - 1) : name.substr(v + 2);
+      for (const char c : pieces) {
+        const auto i = letters.find(c);
+        if (i == letters.npos || i == 0) {
+          return std::nullopt;
+        }
+        ++m.counts[is_white][i];
+      }
+    }
+    return m.pieces() <= max_pieces ? std::optional(m) : std::nullopt;
+  }
+
+  [[nodiscard]] constexpr bool operator==(const material &) const noexcept = default;
+
+  [[nodiscard]] constexpr size_t count(const bool is_white, const piece p) const noexcept {
+    return counts[is_white][std::to_underlying(p)];
+  }
+  constexpr void add(const bool is_white, const piece p, const int n) noexcept {
+    counts[is_white][std::to_underlying(p)] += n;
+  }
+
+  [[nodiscard]] constexpr size_t pieces() const noexcept {
+    size_t n = 2;
+    for (const auto &c : counts) {
+      for (const auto k : c) {
+        n += k;
+      }
+    }
+    return n;
+  }
+
+  [[nodiscard]] constexpr bool has_pawns() const noexcept {
+    return count(true, piece::pawn) || count(false, piece::pawn);
+  }
+
+  [[nodiscard]] constexpr material flipped() const noexcept {
+    material m;
+    m.counts = {counts[1], counts[0]};
+    return m;
+  }
+
+  /** Whether white is at least as strong as black: by the usual piece values, then by rank. */
+  [[nodiscard]] constexpr bool is_canonical() const noexcept {
+    constexpr std::array<int, 7> values{0, 1, 5, 3, 3, 9, 0}; // Indexed by piece.
+    std::array<std::array<int, 6>, 2> keys{};
+    for (const bool is_white : {false, true}) {
+      for (size_t i = 0; i < order.size(); ++i) {
+        const auto n = count(is_white, order[i]);
+        keys[is_white][0] += n * values[std::to_underlying(order[i])];
+        keys[is_white][i + 1] = n;
+      }
+    }
+    return keys[true] >= keys[false];
+  }
+
+  [[nodiscard]] constexpr material canonical() const noexcept {
+    return is_canonical() ? *this : flipped();
+  }
+
+  /** Placements of the pieces the index tells apart, for one side to move. */
+  [[nodiscard]] constexpr size_t placements() const noexcept {
+    size_t n = has_pawns() ? 32 * 64 : 10 * 64;
+    for (const bool is_white : {true, false}) {
+      for (const auto p : order) {
+        for (size_t i = 0; i < count(is_white, p); ++i) {
+          n *= p == piece::pawn ? 48 : 64;
+        }
+      }
+    }
+    return n;
+  }
+
+  /** Entries of its table: every placement with either side to move. */
+  [[nodiscard]] constexpr size_t size() const noexcept { return 2 * placements(); }
+
+  [[nodiscard]] std::string name() const {
+    constexpr std::string_view letters = ".PRNBQ";
+    std::string name;
+    for (const bool is_white : {true, false}) {
+      name += is_white ? "K" : "vK";
+      for (const auto p : order) {
+        name.append(count(is_white, p), letters[std::to_underlying(p)]);
+      }
+    }
+    return name;
+  }
+};
+
+static_assert(material::parse("KRPvKR")->count(true, piece::pawn) == 1);
+static_assert(material::parse("KQvKR")->is_canonical());
+static_assert(!material::parse("KRvKQ")->is_canonical());
+static_assert(material::parse("KQQQvK")->pieces() == max_pieces);
+static_assert(!material::parse("KQQQQvK"));
+
+/** The position seen from the other color: ranks mirrored, colors and the side to move swapped. */
+[[nodiscard]] constexpr configuration flip(const configuration &config) noexcept {
+  auto white = side::empty(), black = side::empty();
+  for (const auto [p, s] : config.get_black()) {
+    white.insert(p, s ^ 56);
+  }
+  for (const auto [p, s] : config.get_white()) {
+    black.insert(p, s ^ 56);
+  }
+  const auto castling = config.get_castling();
+  return configuration(white, black, !config.is_white_turn(),
+                       (castling & 0b0011) << 2 | castling >> 2,
+                       std::byteswap(config.get_en_passant()));
+}
+
+namespace impl {
+
+// Squares are numbered from h1 = 0 to a8 = 63: the file is s % 8 counted from h, the rank s / 8.
+// A symmetry is any combination of mirroring the files (bit 0), mirroring the ranks (bit 1) and
+// then swapping files with ranks (bit 2). Pawns allow mirroring the files only.
+[[nodiscard]] constexpr int transform(int s, const unsigned symmetry) noexcept {
+  s ^= (symmetry & 1 ? 7 : 0) ^ (symmetry & 2 ? 56 : 0);
+  return symmetry & 4 ? s % 8 * 8 + s / 8 : s;
+}
+
+// Where the white king may stand once mirrored: the triangle h1-e1-e4 without pawns, the files h
+// to e with them.
+constexpr auto king_squares = [] {
+  std::array<std::array<int, 32>, 2> squares{}; // By whether pawns are on the board.
+  std::array<size_t, 2> n{};
+  for (int s = 0; s < 64; ++s) {
+    const auto file = s % 8, rank = s / 8;
+    if (file <= 3) {
+      squares[true][n[true]++] = s;
+      if (rank <= file) {
+        squares[false][n[false]++] = s;
+      }
+    }
+  }
+  return squares;
+}();
+constexpr auto king_slots = [] {
+  std::array<std::array<int, 64>, 2> slots{};
+  for (const bool pawns : {false, true}) {
+    std::ranges::fill(slots[pawns], -1);
+    for (int i = 0; i < (pawns ? 32 : 10); ++i) {
+      slots[pawns][king_squares[pawns][i]] = i;
+    }
+  }
+  return slots;
+}();
+
+/** The squares of the kings, then of the pieces in `material::order`, white's before black's. */
+using placement = std::array<int, max_pieces>;
+
+/** The index of a placement of `m` under `symmetry`, the white king landing in its region. */
+[[nodiscard]] constexpr size_t encode(const material &m, placement squares,
+                                      const unsigned symmetry) noexcept {
+  const auto n = m.pieces();
+  for (size_t i = 0; i < n; ++i) {
+    squares[i] = transform(squares[i], symmetry);
+  }
+  const auto pawns = m.has_pawns();
+  size_t index = king_slots[pawns][squares[0]] * 64 + squares[1];
+  for (size_t i = 2; const bool is_white : {true, false}) {
+    for (const auto p : material::order) {
+      // Alike pieces could be listed in any order; the index takes them lowest square first.
+      const auto k = m.count(is_white, p);
+      std::sort(squares.begin() + i, squares.begin() + i + k);
+      for (const auto end = i + k; i < end; ++i) {
+        index = p == piece::pawn ? index * 48 + squares[i] - 8 : index * 64 + squares[i];
+      }
+    }
+  }
+  return index;
+}
+
+} // namespace impl
+
+/**
+ * Where `config`, whose material MUST be `m` and which holds neither castling rights nor an en
+ * passant square, lies in the table of `m`. Symmetric placements share an index.
+ */
+[[nodiscard]] constexpr size_t index(const material &m, const configuration &config) noexcept {
+  impl::placement squares{};
+  squares[0] = config.get_white().get_king_square();
+  squares[1] = config.get_black().get_king_square();
+  for (size_t i = 2; const bool is_white : {true, false}) {
+    const auto &s = is_white ? config.get_white() : config.get_black();
+    for (const auto p : material::order) {
+      for (auto b = s.get_bitboard(p); b; b &= b - 1) {
+        squares[i++] = std::countr_zero(b);
+      }
+    }
+  }
+  const auto base = config.is_white_turn() ? 0 : m.placements();
+  const auto file = squares[0] % 8, rank = squares[0] / 8;
+  if (m.has_pawns()) {
+    return base + impl::encode(m, squares, file > 3);
+  }
+  unsigned symmetry = (file > 3) | (rank > 3) << 1;
+  const auto king = impl::transform(squares[0], symmetry);
+  if (king / 8 > king % 8) {
+    symmetry |= 4;
+  }
+  const auto index = impl::encode(m, squares, symmetry);
+  // On the diagonal, the king stays put when files and ranks are swapped; either will do.
+  if (king / 8 == king % 8) {
+    return base + std::min(index, impl::encode(m, squares, symmetry ^ 4));
+  }
+  return base + index;
+}
+
+/**
+ * The position at `index` in the table of `m`, built with one king per side as `configuration`
+ * requires; nothing if the placement is not one `tablebase::index` yields, as with two pieces on
+ * one square, or if the side that just moved is in check.
+ */
+[[nodiscard]] constexpr std::optional<configuration> position(const material &m,
+                                                             const size_t index) noexcept {
+  // Which piece of which color each square of the placement is for.
+  std::array<piece, max_pieces> kinds{piece::king, piece::king};
+  std::array<bool, max_pieces> whites{true, false};
+  const auto n = m.pieces();
+  for (size_t i = 2; const bool is_white : {true, false}) {
+    for (const auto p : material::order) {
+      for (size_t k = 0; k < m.count(is_white, p); ++k, ++i) {
+        kinds[i] = p;
+        whites[i] = is_white;
+      }
+    }
+  }
+  // The squares are the digits of the index, the last piece the least significant.
+  const auto placements = m.placements();
+  const bool white_turn = index < placements;
+  auto rest = index % placements;
+  impl::placement squares{};
+  for (size_t i = n; i-- > 2;) {
+    const auto pawn = kinds[i] == piece::pawn;
+    squares[i] = rest % (pawn ? 48 : 64) + (pawn ? 8 : 0);
+    rest /= pawn ? 48 : 64;
+  }
+  squares[1] = rest % 64;
+  squares[0] = impl::king_squares[m.has_pawns()][rest / 64];
+
+  uint64_t occupied = 0;
+  auto white = side::empty(), black = side::empty();
+  for (size_t i = 0; i < n; ++i) {
+    const auto bit = uint64_t{1} << squares[i];
+    if (occupied & bit) {
+      return std::nullopt;
+    }
+    occupied |= bit;
+    (whites[i] ? white : black).insert(kinds[i], squares[i]);
+  }
+  const configuration config(white, black, white_turn, 0, 0);
+  if (configuration(white, black, !white_turn, 0, 0).in_check() ||
+      tablebase::index(m, config) != index) {
+    return std::nullopt;
+  }
+  return config;
+}
+
+/**
+ * An entry is the number of plies to mate plus one, from the side to move: an odd number of
+ * plies wins, an even number loses. Zero is a draw, or while building, not yet known.
+ */
+constexpr uint8_t draw = 0;
+
+[[nodiscard]] constexpr bool is_win(const uint8_t entry) noexcept {
+  return entry && entry % 2 == 0;
+}
+[[nodiscard]] constexpr bool is_loss(const uint8_t entry) noexcept { return entry % 2 == 1; }
+
+template <class Lookup>
+[[nodiscard]] uint8_t entry(const configuration &config, Lookup &&lookup, int limit) noexcept;
+
+/**
+ * The entry of `config` as its moves have it: won if one leads to a lost position, lost if all
+ * lead to won ones, and otherwise drawn. Entries of `limit` plies or more count as unknown, which
+ * lets a builder settle positions in order of distance.
+ */
+template <class Lookup>
+[[nodiscard]] uint8_t evaluate(const configuration &config, Lookup &&lookup,
+                               const int limit) noexcept {
+  const auto moves = config.generate_legal_moves();
+  if (moves.empty()) {
+    return config.in_check() && limit > 0 ? 1 : draw;
+  }
+  auto win = std::numeric_limits<int>::max(), loss = 0;
+  bool all_won = true;
+  for (const auto m : moves) {
+    // One ply further from mate than the position it leads to.
+    const auto e = entry(config.play(m), lookup, limit - 1);
+    if (is_loss(e)) {
+      win = std::min<int>(win, e);
+    } else if (is_win(e)) {
+      loss = std::max<int>(loss, e);
+    } else {
+      all_won = false;
+    }
+  }
+  if (win != std::numeric_limits<int>::max()) {
+    return win + 1;
+  }
+  return all_won ? loss + 1 : draw;
+}
+
+/**
+ * The entry of `config`, which holds no castling rights, as `lookup(material, index)` has it for
+ * canonical materials. A position with an en passant square is not in any table; its moves are.
+ */
+template <class Lookup>
+[[nodiscard]] uint8_t entry(const configuration &config, Lookup &&lookup,
+                            const int limit) noexcept {
+  if (config.get_en_passant()) {
+    return evaluate(config, lookup, limit);
+  }
+  const auto m = material::of(config);
+  if (m.pieces() == 2) {
+    return draw;
+  }
+  const auto e = m.is_canonical() ? lookup(m, index(m, config))
+                                  : lookup(m.flipped(), index(m.flipped(), flip(config)));
+  return e - 1 < limit ? e : draw;
+}
+
+/**
+ * Calls `f` with every position one move of the side that just moved could have come from within
+ * the same material: its pieces step back to empty squares, and nothing is uncaptured or
+ * unpromoted. Some of them may have the side to move in check.
+ */
+void for_each_predecessor(const configuration &config, auto &&f) noexcept {
+  const bool is_white = !config.is_white_turn(); // Who moved.
+  const auto &mover = is_white ? config.get_white() : config.get_black();
+  const auto &other = is_white ? config.get_black() : config.get_white();
+  const auto occupied = mover.get_occupancy() | other.get_occupancy();
+  for (const auto [p, s] : mover) {
+    uint64_t sources = 0;
+    switch (p) {
+    case piece::pawn: {
+      const auto bit = uint64_t{1} << s;
+      const auto one = is_white ? bit >> 8 : bit << 8;
+      const auto two = is_white ? bit >> 16 : bit << 16;
+      // A pawn stands on its second rank at least, and steps twice only from there.
+      if (!(one & occupied) && (is_white ? s / 8 >= 2 : s / 8 <= 5)) {
+        sources = one;
+        if (s / 8 == (is_white ? 3 : 4) && !(two & occupied)) {
+          sources |= two;
+        }
+      }
+      break;
+    }
+    case piece::rook:
+      sources = attacks::rook(s, occupied);
+      break;
+    case piece::knight:
+      sources = attacks::knight(s);
+      break;
+    case piece::bishop:
+      sources = attacks::bishop(s, occupied);
+      break;
+    case piece::queen:
+      sources = attacks::queen(s, occupied);
+      break;
+    case piece::king:
+      sources = attacks::king(s);
+      break;
+    case piece::empty:
+      std::unreachable();
+    }
+    for (sources &= ~occupied; sources; sources &= sources - 1) {
+      auto before = mover;
+      before.erase(s);
+      before.insert(p, std::countr_zero(sources));
+      f(is_white ? configuration(before, other, true, 0, 0)
+                 : configuration(other, before, false, 0, 0));
+    }
+  }
+}
+
+/** Whether the side to move wins, draws or loses, and how many plies until mate. */
+struct probe_result {
+  enum class wdl : int8_t { loss = -1, draw = 0, win = 1 } value;
+  int plies; // 0 for a draw.
+
+  [[nodiscard]] static constexpr probe_result of(const uint8_t entry) noexcept {
+    return is_win(entry)    ? probe_result{wdl::win, entry - 1}
+           : is_loss(entry) ? probe_result{wdl::loss, entry - 1}
+                            : probe_result{wdl::draw, 0};
+  }
+};
+
+namespace impl {
+
+// A table file: this 64-byte header, the offsets of the blocks and of their end, then the
+// blocks, little endian. A block holds `block_size` entries as runs: an entry, then how many
+// times it repeats as a LEB128 number.
+struct table_file_header {
+  std::array<char, 8> magic{'C', 'H', 'E', 'S', 'S', 'E', 'G', 'T'};
+  uint32_t version = 1;
+  uint32_t block_size = 4096;
+  std::array<std::array<uint8_t, 7>, 2> counts{}; // Of the material, as `material` has them.
+  std::array<uint8_t, 2> padding{};
+  uint64_t entries = 0;
+  std::array<char, 24> reserved{};
+
+  [[nodiscard]] bool operator==(const table_file_header &) const = default;
+};
+static_assert(sizeof(table_file_header) == 64);
+
+} // namespace impl
+
+/**
+ * Writes the entries of `m` to a table file at `path`. An entry whose bit is set in `invalid`
+ * is never probed, so it takes whatever value lengthens the run it falls in.
+ */
+inline bool write_table(const char *const path, const material &m,
+                        const std::span<const uint8_t> entries,
+                        const std::span<const uint64_t> invalid) {
+  impl::table_file_header header;
+  for (const bool is_white : {false, true}) {
+    for (const auto p : material::order) {
+      header.counts[is_white][std::to_underlying(p)] = m.count(is_white, p);
+    }
+  }
+  header.entries = entries.size();
+  const auto blocks = (entries.size() + header.block_size - 1) / header.block_size;
+  std::vector<uint64_t> offsets{0};
+  std::vector<uint8_t> data;
+  for (size_t block = 0; block < blocks; ++block) {
+    const auto first = block * header.block_size;
+    const auto last = std::min(first + header.block_size, entries.size());
+    const auto valid = [&](const size_t i) { return !(invalid[i / 64] >> i % 64 & 1); };
+    auto value = draw;
+    for (auto i = first; i < last; ++i) {
+      if (valid(i)) {
+        value = entries[i];
+        break;
+      }
+    }
+    for (auto i = first; i < last;) {
+      auto run = i + 1;
+      while (run < last && (!valid(run) || entries[run] == value)) {
+        ++run;
+      }
+      data.push_back(value);
+      for (auto n = run - i; n; n >>= 7) {
+        data.push_back((n & 0x7F) | (n > 0x7F ? 0x80 : 0));
+      }
+      i = run;
+      if (i < last) {
+        value = entries[i];
+      }
+    }
+    offsets.push_back(data.size());
+  }
+  std::FILE *const file = std::fopen(path, "wb");
+  if (!file) {
+    return false;
+  }
+  bool ok = std::fwrite(&header, sizeof(header), 1, file) == 1;
+  ok = ok && std::fwrite(offsets.data(), sizeof(uint64_t), offsets.size(), file) == offsets.size();
+  ok = ok && std::fwrite(data.data(), 1, data.size(), file) == data.size();
+  return std::fclose(file) == 0 && ok;
+}
+
+/** A table file mapped read-only; only the block that holds an entry is decoded to read it. */
+class table_file {
+  mapped_file file;
+  material m;
+
+  table_file(mapped_file &&file, const material m) noexcept : file(std::move(file)), m(m) {}
+
+  [[nodiscard]] const impl::table_file_header &header() const noexcept {
+    return *file.at<impl::table_file_header>(0);
+  }
+  [[nodiscard]] size_t blocks() const noexcept {
+    return (header().entries + header().block_size - 1) / header().block_size;
+  }
+  [[nodiscard]] const uint64_t *offsets() const noexcept {
+    return file.at<uint64_t>(sizeof(impl::table_file_header));
+  }
+  [[nodiscard]] const uint8_t *data() const noexcept {
+    return reinterpret_cast<const uint8_t *>(offsets() + blocks() + 1);
+  }
+
+public:
+  /** Maps the file at `path`; nothing if it cannot or the file is no table of this version. */
+  [[nodiscard]] static std::optional<table_file> open(const char *const path) noexcept {
+    auto file = mapped_file::open(path);
+    if (!file) {
+      return std::nullopt;
+    }
+    if (file->size() < sizeof(impl::table_file_header)) {
+      std::fprintf(stderr, "%s: not a table file\n", path);
+      return std::nullopt;
+    }
+    // Only the material and the number of entries may differ from a default header.
+    const auto &header = *file->at<impl::table_file_header>(0);
+    impl::table_file_header expected;
+    expected.counts = header.counts;
+    expected.entries = header.entries;
+    material m;
+    for (const bool is_white : {false, true}) {
+      for (const auto p : material::order) {
+        m.add(is_white, p, expected.counts[is_white][std::to_underlying(p)]);
+      }
+    }
+    if (header != expected || expected.entries != m.size() || m.pieces() > max_pieces ||
+        !m.is_canonical()) {
+      std::fprintf(stderr, "%s: not a table file of this version\n", path);
+      return std::nullopt;
+    }
+    // The offsets of the blocks, and one past the last, then the runs they point to.
+    const auto blocks = (header.entries + header.block_size - 1) / header.block_size;
+    const auto runs = sizeof(header) + (blocks + 1) * sizeof(uint64_t);
+    if (file->size() < runs ||
+        file->size() != runs + *file->at<uint64_t>(runs - sizeof(uint64_t))) {
+      std::fprintf(stderr, "%s: not a table file of this version\n", path);
+      return std::nullopt;
+    }
+    return table_file(std::move(*file), m);
+  }
+
+  [[nodiscard]] const material &get_material() const noexcept { return m; }
+
+  /** The entry at `index`, found by walking the runs of its block. */
+  [[nodiscard]] uint8_t operator[](const size_t index) const noexcept {
+    assert(index < header().entries);
+    const auto block_size = header().block_size;
+    const auto *p = data() + offsets()[index / block_size];
+    for (auto rest = index % block_size;;) {
+      const auto value = *p++;
+      size_t run = 0;
+      for (unsigned shift = 0;; shift += 7) {
+        run |= size_t{*p & 0x7Fu} << shift;
+        if (!(*p++ & 0x80)) {
+          break;
+        }
+      }
+      if (rest < run) {
+        return value;
+      }
+      rest -= run;
+    }
+  }
+};
+
+/** The table files of a directory, probed by position; safe to share between threads. */
+class prober {
+  std::vector<table_file> tables;
+
+public:
+  /** Maps every `.tb` file of `directory`; those that cannot be are left out. */
+  explicit prober(const std::filesystem::path &directory) {
+    std::error_code error;
+    for (std::filesystem::directory_iterator it(directory, error), end; !error && it != end;
+         it.increment(error)) {
+      if (it->path().extension() == ".tb") {
+        if (auto table = table_file::open(it->path().c_str())) {
+          tables.push_back(std::move(*table));
+        }
+      }
+    }
+  }
+
+  [[nodiscard]] size_t size() const noexcept { return tables.size(); }
+
+  /** The outcome of `config`; nothing if a table it needs is missing or it may still castle. */
+  [[nodiscard]] std::optional<probe_result> probe(const configuration &config) const noexcept {
+    if (config.get_castling() || material::of(config).pieces() > max_pieces) {
+      return std::nullopt;
+    }
+    bool missing = false;
+    const auto lookup = [this, &missing](const material &m, const size_t index) -> uint8_t {
+      for (const auto &table : tables) {
+        if (table.get_material() == m) {
+          return table[index];
+        }
+      }
+      missing = true;
+      return draw;
+    };
+    const auto e = entry(config, lookup, std::numeric_limits<int>::max());
+    return missing ? std::nullopt : std::optional(probe_result::of(e));
+  }
+};
+
+/** A table as built, with the positions its indices do not stand for. */
+struct built_table {
+  material m;
+  std::vector<uint8_t> entries;
+  std::vector<uint64_t> invalid; // One bit per entry.
+  int max_plies = 0;
+  std::chrono::nanoseconds elapsed;
+};
+
+/**
+ * Builds tables by retrograde analysis, on several threads. Positions are settled in order of
+ * their distance to mate: every iteration steps back from the positions settled by the previous
+ * one to those that could have led to them, and verifies each with its moves. Tables of the
+ * materials a capture or promotion leads to are built first and kept in memory.
+ */
+class generator {
+  unsigned threads;
+  std::vector<built_table> tables;
+
+  /** Calls `f(i)` for every `i` below `n`, spread over the threads in chunks. */
+  void parallel_for(const size_t n, auto &&f) const {
+    constexpr size_t chunk = 1 << 14;
+    std::atomic<size_t> next = 0;
+    const auto work = [&] {
+      for (size_t first; (first = next.fetch_add(chunk, std::memory_order_relaxed)) < n;) {
+        for (auto i = first; i < std::min(first + chunk, n); ++i) {
+          f(i);
+        }
+      }
+    };
+    std::vector<std::jthread> workers;
+    for (unsigned i = 1; i < threads; ++i) {
+      workers.emplace_back(work);
+    }
+    work();
+  }
+
+  [[nodiscard]] const built_table *find(const material &m) const noexcept {
+    for (const auto &table : tables) {
+      if (table.m == m) {
+        return &table;
+      }
+    }
+    return nullptr;
+  }
+
+  void build_one(const material &m, auto &&report) {
+    const auto start = std::chrono::steady_clock::now();
+    const auto size = m.size();
+    built_table table{m, std::vector<uint8_t>(size), std::vector<uint64_t>((size + 63) / 64)};
+    std::vector<uint8_t> hints(size); // The distance a capture or promotion settles at, if any.
+    std::vector<uint64_t> sticky((size + 63) / 64), candidates((size + 63) / 64);
+    const auto set = [](std::vector<uint64_t> &bits, const size_t i) {
+      std::atomic_ref(bits[i / 64]).fetch_or(uint64_t{1} << i % 64, std::memory_order_relaxed);
+    };
+    const auto test = [](const std::vector<uint64_t> &bits, const size_t i) {
+      return bits[i / 64] >> i % 64 & 1;
+    };
+    const auto lookup = [this, &table](const material &other, const size_t index) -> uint8_t {
+      if (other == table.m) {
+        return std::atomic_ref(table.entries[index]).load(std::memory_order_relaxed);
+      }
+      return find(other)->entries[index];
+    };
+    int sub_plies = 0;
+    for (const auto &t : tables) {
+      sub_plies = std::max(sub_plies, t.max_plies);
+    }
+
+    // Mates, and what captures and promotions lead to: those tables are complete already.
+    std::atomic<bool> any_sticky = false;
+    std::atomic<int> horizon = 0;
+    parallel_for(size, [&](const size_t i) {
+      const auto config = position(m, i);
+      if (!config) {
+        set(table.invalid, i);
+        return;
+      }
+      const auto moves = config->generate_legal_moves();
+      if (moves.empty()) {
+        table.entries[i] = config->in_check() ? 1 : draw;
+        return;
+      }
+      auto win = std::numeric_limits<int>::max(), loss = 0; // In plies.
+      bool drawn = false;
+      for (const auto mv : moves) {
+        const auto child = config->play(mv);
+        if (child.get_en_passant()) {
+          set(sticky, i);
+          any_sticky.store(true, std::memory_order_relaxed);
+          continue;
+        }
+        if (material::of(child) == m) {
+          continue;
+        }
+        const auto e = entry(child, lookup, std::numeric_limits<int>::max());
+        if (is_loss(e)) {
+          win = std::min<int>(win, e);
+        } else if (is_win(e)) {
+          loss = std::max<int>(loss, e);
+        } else {
+          drawn = true;
+        }
+      }
+      // A capture that wins settles the position at its distance unless a move within the
+      // table wins sooner; one that loses only bounds how late it can be lost.
+      const auto hint = win != std::numeric_limits<int>::max() ? win
+                        : !drawn && loss                     ? loss
+                                                             : 0;
+      if (hint && hint < 255) {
+        hints[i] = hint;
+        auto h = horizon.load(std::memory_order_relaxed);
+        while (h < hint && !horizon.compare_exchange_weak(h, hint, std::memory_order_relaxed)) {
+        }
+      }
+    });
+    // An en passant square lets a capture decide at any distance its table holds.
+    const auto last = std::max(horizon.load(), any_sticky ? sub_plies + 2 : 0);
+
+    // Iteration k settles the positions k plies from mate.
+    std::atomic<size_t> settled = 1; // Any, for the first iteration to look at mates.
+    for (int k = 1; k < 255 && (k <= last || settled.load() > 0); ++k) {
+      std::ranges::fill(candidates, 0);
+      parallel_for(size, [&](const size_t i) {
+        if (table.entries[i] != k) {
+          return;
+        }
+        for_each_predecessor(*position(m, i), [&](const configuration &before) {
+          set(candidates, index(m, before));
+        });
+      });
+      settled = 0;
+      parallel_for(size, [&](const size_t i) {
+        if (test(table.invalid, i) || table.entries[i] != draw ||
+            !(test(candidates, i) || hints[i] == k || test(sticky, i))) {
+          return;
+        }
+        const auto e = evaluate(*position(m, i), lookup, k + 1);
+        if (e != draw) {
+          std::atomic_ref(table.entries[i]).store(e, std::memory_order_relaxed);
+          settled.fetch_add(1, std::memory_order_relaxed);
+        }
+      });
+      if (settled.load() > 0) {
+        table.max_plies = k;
+      }
+    }
+    table.elapsed = std::chrono::steady_clock::now() - start;
+    report(std::as_const(table));
+    tables.push_back(std::move(table));
+  }
+
+public:
+  explicit generator(const unsigned threads) noexcept : threads(threads) {}
+
+  /**
+   * Builds the table of `m`, canonical and with more than the kings, after those it depends on
+   * that are not built yet; calls `report(table)` as each one is done.
+   */
+  void build(const material &m, auto &&report) {
+    if (find(m)) {
+      return;
+    }
+    for (const bool is_white : {true, false}) {
+      for (const auto p : material::order) {
+        if (!m.count(is_white, p)) {
+          continue;
+        }
+        auto captured = m;
+        captured.add(is_white, p, -1);
+        if (captured.pieces() > 2) {
+          build(captured.canonical(), report);
+        }
+        if (p == piece::pawn) {
+          for (const auto promotion : {piece::queen, piece::rook, piece::bishop, piece::knight}) {
+            auto promoted = m;
+            promoted.add(is_white, p, -1);
+            promoted.add(is_white, promotion, 1);
+            build(promoted.canonical(), report);
+          }
+        }
+      }
+    }
+    build_one(m, report);
+  }
+};
+
+} // namespace tablebase
@@ -0,0 +1,209 @@
+// https://www.chessprogramming.org/Transposition_Table
+#pragma once
+#include "chess.hpp"
+#include <atomic>
+#include <cstdio>
+#include <limits>
+#include <memory>
+#include <optional>
+#include <sys/mman.h>
+
+/**
+ * Shared table of search results, keyed by the Zobrist key of a configuration. Each bucket fills
+ * one cache line with 4 entries of two words written without locks: the first holds key ^ data,
+ * so a torn entry written by racing threads fails verification instead of returning another
+ * position's result, and the key itself costs no space.
+ */
+class transposition_table {
+public:
+  /** How `score` relates to the true score of the position. */
+  enum class bound : uint8_t { none, upper, lower, exact };
+
+  struct hit {
+    std::optional<move> best;
+    int score, depth;
+    enum bound bound;
+  };
+
+  /** Kept by each searching thread, so that counting costs no shared writes. */
+  struct counters {
+    uint64_t probes = 0, hits = 0, stores = 0;
+
+    constexpr counters &operator+=(const counters &other) noexcept {
+      probes += other.probes;
+      hits += other.hits;
+      stores += other.stores;
+      return *this;
+    }
+    [[nodiscard]] constexpr double hit_rate() const noexcept {
+      return probes ? static_cast<double>(hits) / static_cast<double>(probes) : 0;
+    }
+  };
+
+private:
+  struct entry {
+    // data: move (16 bits) | score (16) << 16 | depth (8) << 32 | bound (2) << 40 | age (6) << 42
+    std::atomic<uint64_t> check, data;
+  };
+  static constexpr size_t ways = 4;
+  struct alignas(64) bucket {
+    std::array<entry, ways> entries;
+  };
+  static_assert(sizeof(bucket) == 64);
+
+  static constexpr size_t huge_page = 2 * 1024 * 1024;
+  static constexpr uint64_t age_cycle = 64;
+
+  bucket *buckets;
+  size_t mask, bytes;
+  uint8_t generation = 0;
+
+  [[nodiscard]] static constexpr uint64_t pack(const std::optional<move> m) noexcept {
+    if (!m) {
+      return 0; // h1h1 is never a move.
+    }
+    return static_cast<uint64_t>(m->get_src_square()) |
+           static_cast<uint64_t>(m->get_dst_square()) << 6 |
+           static_cast<uint64_t>(std::to_underlying(m->get_promotion())) << 12;
+  }
+
+  [[nodiscard]] static constexpr std::optional<move> unpack(const uint64_t data) noexcept {
+    const square src = data & 0x3F, dst = data >> 6 & 0x3F;
+    if (src == dst) {
+      return std::nullopt;
+    }
+    return move(src, dst, static_cast<piece>(data >> 12 & 0xF));
+  }
+
+  [[nodiscard]] static constexpr int depth_of(const uint64_t data) noexcept {
+    return static_cast<int8_t>(data >> 32);
+  }
+  [[nodiscard]] static constexpr enum bound bound_of(const uint64_t data) noexcept {
+    return static_cast<enum bound>(data >> 40 & 0b11);
+  }
+  [[nodiscard]] constexpr int age_of(const uint64_t data) const noexcept {
+    return (generation - (data >> 42)) % age_cycle;
+  }
+
+public:
+  /**
+   * Takes about `megabytes` of memory, rounded down to a power of two buckets, on huge pages
+   * where the system has them to spare; otherwise transparent huge pages are requested.
+   */
+  explicit transposition_table(const size_t megabytes)
+      : mask(std::bit_floor(std::max<size_t>(megabytes * 1024 * 1024 / sizeof(bucket), 1)) - 1),
+        bytes((mask + 1) * sizeof(bucket)) {
+    void *memory = MAP_FAILED;
+#ifdef MAP_HUGETLB
+    if (bytes % huge_page == 0) {
+      memory = mmap(nullptr, bytes, PROT_READ | PROT_WRITE,
+                    MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+    }
+#endif
+    if (memory == MAP_FAILED) {
+      memory = mmap(nullptr, bytes, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+#ifdef MADV_HUGEPAGE
+      if (memory != MAP_FAILED) {
+        madvise(memory, bytes, MADV_HUGEPAGE);
+      }
+#endif
+    }
+    if (memory == MAP_FAILED) {
+      std::perror("transposition_table");
+      std::abort();
+    }
+    buckets = static_cast<bucket *>(memory);
+    std::uninitialized_value_construct_n(buckets, mask + 1);
+  }
+
+  transposition_table(const transposition_table &) = delete;
+  transposition_table &operator=(const transposition_table &) = delete;
+  ~transposition_table() { munmap(buckets, bytes); }
+
+  [[nodiscard]] size_t size() const noexcept { return (mask + 1) * ways; }
+
+  void clear() noexcept {
+    for (size_t i = 0; i <= mask; ++i) {
+      for (auto &e : buckets[i].entries) {
+        e.check.store(0, std::memory_order_relaxed);
+        e.data.store(0, std::memory_order_relaxed);
+      }
+    }
+    generation = 0;
+  }
+
+  /** Called before each search, while no thread uses the table, to age what older ones left. */
+  void new_search() noexcept { generation = (generation + 1) % age_cycle; }
+
+  /** Starts loading the bucket of `config`; call it right after making the move leading there. */
+  template <class Side> void prefetch(const basic_configuration<Side> &config) const noexcept {
+    __builtin_prefetch(&buckets[config.get_key() & mask]);
+  }
+
+  template <class Side>
+  [[nodiscard]] std::optional<hit> probe(const basic_configuration<Side> &config,
+                                         counters &tally) const noexcept {
+    const auto key = config.get_key();
+    ++tally.probes;
+    for (const auto &e : buckets[key & mask].entries) {
+      const auto data = e.data.load(std::memory_order_relaxed);
+      const auto check = e.check.load(std::memory_order_relaxed);
+      if ((check ^ data) == key && bound_of(data) != bound::none) {
+        ++tally.hits;
+        return hit{unpack(data), static_cast<int16_t>(data >> 16), depth_of(data), bound_of(data)};
+      }
+    }
+    return std::nullopt;
+  }
+
+  /**
+   * Replaces the entry of the same position, else the one worth least: shallow results from
+   * older searches go first. The best move already known is kept when `best` is empty.
+   */
+  template <class Side>
+  void store(const basic_configuration<Side> &config, std::optional<move> best, const int score,
+             const int depth, const enum bound kind, counters &tally) noexcept {
+    assert(kind != bound::none);
+    assert(-32768 <= score && score < 32768 && -128 <= depth && depth < 128);
+    const auto key = config.get_key();
+    auto &entries = buckets[key & mask].entries;
+    auto *victim = &entries[0];
+    auto worth = std::numeric_limits<int>::max();
+    for (auto &e : entries) {
+      const auto data = e.data.load(std::memory_order_relaxed);
+      if ((e.check.load(std::memory_order_relaxed) ^ data) == key) {
+        if (!best) {
+          best = unpack(data);
+        }
+        victim = &e;
+        break;
+      }
+      const auto w = bound_of(data) == bound::none ? std::numeric_limits<int>::min()
+                                                   : depth_of(data) - 8 * age_of(data);
+      if (w < worth) {
+        worth = w;
+        victim = &e;
+      }
+    }
+    ++tally.stores;
+    const auto data = pack(best) | static_cast<uint64_t>(static_cast<uint16_t>(score)) << 16 |
+                      static_cast<uint64_t>(static_cast<uint8_t>(depth)) << 32 |
+                      static_cast<uint64_t>(std::to_underlying(kind)) << 40 |
+                      static_cast<uint64_t>(generation) << 42;
+    victim->check.store(key ^ data, std::memory_order_relaxed);
+    victim->data.store(data, std::memory_order_relaxed);
+  }
+
+  /** Per mille of the entries written by the current search, sampled from the first buckets. */
+  [[nodiscard]] unsigned occupancy() const noexcept {
+    const auto sample = std::min<size_t>(mask + 1, 250);
+    unsigned used = 0;
+    for (size_t i = 0; i < sample; ++i) {
+      for (const auto &e : buckets[i].entries) {
+        const auto data = e.data.load(std::memory_order_relaxed);
+        used += bound_of(data) != bound::none && age_of(data) == 0;
+      }
+    }
+    return used * 1000 / (sample * ways);
+  }
+};
@@ -0,0 +1,25 @@
+// https://www.chessprogramming.org/Algebraic_Chess_Notation#Pure_coordinate_notation
+#pragma once
+#include "chess.hpp"
+#include <ostream>
+
+/** Pure coordinate notation, as UCI speaks it: e2e4, e1g1 for castling, e7e8q. */
+inline std::ostream &operator<<(std::ostream &os, const move m) {
+  const auto name = [&os](const square s) -> auto & {
+    return os << static_cast<char>('h' - s % 8) << static_cast<char>('1' + s / 8);
+  };
+  name(m.get_src_square());
+  name(m.get_dst_square());
+  switch (m.get_promotion()) {
+  case piece::queen:
+    return os << 'q';
+  case piece::rook:
+    return os << 'r';
+  case piece::bishop:
+    return os << 'b';
+  case piece::knight:
+    return os << 'n';
+  default:
+    return os;
+  }
+}